@@ -40,7 +40,9 @@ oriented support that the pyecc module does\n\
 static char new_state_doc[] = "\
 Generate a new ECC_State object that will ensure the \
 libgcrypt state necessary for crypto is all set up and \
-ready for use\n\
+ready for use; optionally expects a flag which lets \
+decrypt accept data whose MAC doesn't cover the ciphertext, \
+as written by older versions of encrypt\n\
 ";
 static void *_release_state(void *_state)
 {
@@ -50,7 +52,28 @@ static void *_release_state(void *_state)
 }
 static PyObject *py_new_state(PyObject *self, PyObject *args, PyObject *kwargs)
 {
-    ECC_State state = ecc_new_state(NULL);
+    ECC_State state;
+    ECC_Options opts = NULL;
+    int legacy_mac = 0;
+
+    if (!PyArg_ParseTuple(args, "|i", &legacy_mac))
+        return NULL;
+
+    if (legacy_mac) {
+        if (!(opts = ecc_new_options()))
+            Py_RETURN_NONE;
+        /*
+         * Keep the defaults of a state without options apart from the flag
+         */
+        opts->secure_random = false;
+        opts->legacy_mac = true;
+    }
+
+    state = ecc_new_state(opts);
+    if (!state) {
+        free(opts);
+        Py_RETURN_NONE;
+    }
 
     PyObject *rc = PyCObject_FromVoidPtr(state, (fp)(_release_state));
     if (!PyCObject_Check(rc)) {
@@ -89,12 +112,30 @@ static PyObject *py_encrypt(PyObject *self, PyObject *args, PyObject *kwargs)
     state = (ECC_State)(PyCObject_AsVoidPtr(temp_state));
     keypair = (ECC_KeyPair)(PyCObject_AsVoidPtr(temp_keypair));
 
-    ECC_Data result = ecc_encrypt(data, datalen, keypair, state);
-
-    if ( (result == NULL) || (result->data == NULL) )
+    if ( (state == NULL) || (state->curveparams == NULL) )
         Py_RETURN_NONE;
 
-    return PyString_FromStringAndSize((char *)(result->data), result->datalen);
+    /*
+     * Encrypt straight into the string we return instead of copying
+     * out of an ECC_Data
+     */
+    PyObject *rc = PyString_FromStringAndSize(NULL, 
+            ecc_encrypted_len(datalen, state));
+    bool result;
+
+    if (rc == NULL)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = ecc_encrypt_into(data, datalen, PyString_AS_STRING(rc), keypair, 
+            state);
+    Py_END_ALLOW_THREADS
+
+    if (!result) {
+        Py_DECREF(rc);
+        Py_RETURN_NONE;
+    }
+    return rc;
 }
 
 static char decrypt_doc[] = "\
@@ -124,7 +165,11 @@ static PyObject *py_decrypt(PyObject *self, PyObject *args, PyObject *kwargs)
     encrypted->data = data;
     encrypted->datalen = datalen;
 
-    ECC_Data result = ecc_decrypt(encrypted, keypair, state);
+    ECC_Data result;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = ecc_decrypt(encrypted, keypair, state);
+    Py_END_ALLOW_THREADS
 
     if ( (result == NULL) || (result->data == NULL) )
         Py_RETURN_NONE;
@@ -140,13 +185,10 @@ static void *_release_keypair(void *_keypair)
 {
     if (_keypair) {
         ECC_KeyPair kp = (ECC_KeyPair)(_keypair);
-        if (kp->priv) {
-            free(kp->priv);
-        }
         if (kp->pub) {
             free(kp->pub);
         }
-        free(kp);
+        ecc_free_keypair(kp);
     }
     Py_RETURN_NONE;
 }
@@ -182,6 +224,95 @@ static PyObject *py_new_keypair(PyObject *self, PyObject *args, PyObject *kwargs
 }
 
 
+static char new_keypair_bin_doc[] = "\
+Return a new ECC_KeyPair object from binary keys, expects the \
+binary public key (or None), the binary private key (or None) \
+and a ECC_State PyCObject\n\
+";
+static PyObject *py_new_keypair_bin(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    char *privkey, *temp_pubkey, *pubkey = NULL;
+    PyObject *temp_state;
+    ECC_State state;
+    unsigned int pubkeylen, privkeylen;
+
+    if (!PyArg_ParseTuple(args, "z#z#O", &temp_pubkey, &pubkeylen, 
+                &privkey, &privkeylen, &temp_state))
+        return NULL;
+
+    /*
+     * Copying into a separate buffer lest Python deallocate our
+     * string out from under us
+     */
+    if (temp_pubkey) {
+        pubkey = (char *)(malloc(sizeof(char) * pubkeylen + 1));
+        if (pubkey == NULL)
+            return PyErr_NoMemory();
+        memcpy(pubkey, temp_pubkey, pubkeylen + 1);
+    }
+    
+    state = (ECC_State)(PyCObject_AsVoidPtr(temp_state));
+
+    ECC_KeyPair kp = ecc_new_keypair_bin(pubkey, pubkeylen, privkey, 
+            privkeylen, state);
+
+    if (kp == NULL) {
+        free(pubkey);
+        Py_RETURN_NONE;
+    }
+
+    PyObject *rc = PyCObject_FromVoidPtr(kp, (fp)(_release_keypair));
+    if (!PyCObject_Check(rc)) {
+        _release_keypair(kp);
+        Py_RETURN_NONE;
+    }
+    return rc;
+}
+
+static char export_bin_doc[] = "\
+Return the binary forms of the keys in a ECC_KeyPair PyCObject, \
+expects to be passed the keypair and a ECC_State PyCObject; returns \
+a tuple (binary public key, binary private key), either of which is \
+None if the keypair does not hold it\n\
+";
+static PyObject *_data_to_string(ECC_Data data)
+{
+    PyObject *rc;
+
+    if (data == NULL)
+        Py_RETURN_NONE;
+    rc = PyString_FromStringAndSize((char *)(data->data), data->datalen);
+    ecc_free_data(data);
+    return rc;
+}
+static PyObject *py_export_bin(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *temp_state, *temp_keypair, *pub, *priv;
+    ECC_State state;
+    ECC_KeyPair keypair;
+
+    if (!PyArg_ParseTuple(args, "OO", &temp_keypair, &temp_state))
+        return NULL;
+
+    state = (ECC_State)(PyCObject_AsVoidPtr(temp_state));
+    keypair = (ECC_KeyPair)(PyCObject_AsVoidPtr(temp_keypair));
+
+    if ( (keypair == NULL) || (state == NULL) )
+        Py_RETURN_NONE;
+
+    pub = _data_to_string(keypair->pub ? 
+            ecc_public_key_bin(keypair, state) : NULL);
+    priv = _data_to_string(keypair->priv ? 
+            ecc_private_key_bin(keypair, state) : NULL);
+    if ( (pub == NULL) || (priv == NULL) ) {
+        Py_XDECREF(pub);
+        Py_XDECREF(priv);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", pub, priv);
+}
+
+
 static char verify_doc[] = "\
 Verify that the specified data matches the given signature \
 and vice versa. Should return a True/False depending on the \
@@ -202,7 +333,13 @@ static PyObject *py_verify(PyObject *self, PyObject *args, PyObject *kwargs)
     state = (ECC_State)(PyCObject_AsVoidPtr(temp_state));
     keypair = (ECC_KeyPair)(PyCObject_AsVoidPtr(temp_keypair));
 
-    if (ecc_verify(data, signature, keypair, state)) 
+    bool verified;
+
+    Py_BEGIN_ALLOW_THREADS
+    verified = ecc_verify(data, signature, keypair, state);
+    Py_END_ALLOW_THREADS
+
+    if (verified) 
         Py_RETURN_TRUE;
     Py_RETURN_FALSE;
 }
@@ -228,13 +365,84 @@ static PyObject *py_sign(PyObject *self, PyObject *args, PyObject *kwargs)
     state = (ECC_State)(PyCObject_AsVoidPtr(temp_state));
     keypair = (ECC_KeyPair)(PyCObject_AsVoidPtr(temp_keypair));
 
-    ECC_Data result = ecc_sign(data, keypair, state);
+    ECC_Data result;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = ecc_sign(data, keypair, state);
+    Py_END_ALLOW_THREADS
     if ( (result == NULL) || (result->data == NULL) ) 
         Py_RETURN_NONE;
     
     return PyString_FromString((const char *)(result->data));
 }
 
+static char verify_bin_doc[] = "\
+Verify a binary signature of a buffer of data, expects to be \
+passed the data, the signature, a ECC_KeyPair PyCObject and a \
+ECC_State PyCObject. Should return a True/False\n\
+";
+static PyObject *py_verify_bin(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *temp_state, *temp_keypair;
+    ECC_State state;
+    ECC_KeyPair keypair;
+    char *data, *signature;
+    unsigned int datalen, siglen;
+
+    if (!PyArg_ParseTuple(args, "s#s#OO", &data, &datalen, &signature, 
+            &siglen, &temp_keypair, &temp_state)) {
+        return NULL;
+    }
+
+    state = (ECC_State)(PyCObject_AsVoidPtr(temp_state));
+    keypair = (ECC_KeyPair)(PyCObject_AsVoidPtr(temp_keypair));
+
+    bool verified;
+
+    Py_BEGIN_ALLOW_THREADS
+    verified = ecc_verify_bin(data, datalen, signature, siglen, keypair, 
+            state);
+    Py_END_ALLOW_THREADS
+
+    if (verified) 
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+
+static char sign_bin_doc[] = "\
+Sign the specified buffer of data, which may contain NUL bytes. \
+Should return the binary signature as a string or None\n\
+";
+static PyObject *py_sign_bin(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *temp_state, *temp_keypair;
+    ECC_State state;
+    ECC_KeyPair keypair;
+    char *data;
+    unsigned int datalen;
+
+    if (!PyArg_ParseTuple(args, "s#OO", &data, &datalen, &temp_keypair,
+            &temp_state)) {
+        return NULL;
+    }
+
+    state = (ECC_State)(PyCObject_AsVoidPtr(temp_state));
+    keypair = (ECC_KeyPair)(PyCObject_AsVoidPtr(temp_keypair));
+
+    ECC_Data result;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = ecc_sign_bin(data, datalen, keypair, state);
+    Py_END_ALLOW_THREADS
+    if ( (result == NULL) || (result->data == NULL) ) {
+        ecc_free_data(result);
+        Py_RETURN_NONE;
+    }
+    
+    return _data_to_string(result);
+}
+
 static char keygen_doc[] = "\
 Generate a set of keys, returns a tuple containing \
 three values: (serialized public key, serialized private key, curve)\n\
@@ -249,7 +457,9 @@ static PyObject *py_keygen(PyObject *self, PyObject *args, PyObject *kwargs)
     if (!state)
         Py_RETURN_NONE;
 
+    Py_BEGIN_ALLOW_THREADS
     keypair = ecc_keygen(NULL, state);
+    Py_END_ALLOW_THREADS
     if (!keypair) {
         ecc_free_state(state);
         Py_RETURN_NONE;
@@ -269,20 +479,81 @@ static PyObject *py_keygen(PyObject *self, PyObject *args, PyObject *kwargs)
     return rc;
 }
 
+static char keygen_many_doc[] = "\
+Generate n sets of keys across a pool of worker threads, \
+expects to be passed n and optionally the number of threads; \
+returns a list of (serialized public key, serialized private key, curve) \
+tuples\n\
+";
+static PyObject *py_keygen_many(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    ECC_State state;
+    ECC_KeyPair *keys;
+    unsigned int n, threads = 1, i;
+    char *priv;
+    PyObject *rc, *item;
+
+    if (!PyArg_ParseTuple(args, "I|I", &n, &threads))
+        return NULL;
+
+    state = ecc_new_state(NULL);
+    if (!state)
+        Py_RETURN_NONE;
+
+    Py_BEGIN_ALLOW_THREADS
+    keys = ecc_keygen_many(n, state, threads);
+    Py_END_ALLOW_THREADS
+    if (!keys) {
+        ecc_free_state(state);
+        Py_RETURN_NONE;
+    }
+
+    rc = PyList_New(n);
+
+    for (i = 0; (rc != NULL) && (i < n); ++i) {
+        priv = ecc_serialize_private_key(keys[i], state);
+        item = Py_BuildValue("(sss)", (const char *)(keys[i]->pub), priv, 
+                DEFAULT_CURVE);
+        free(priv);
+
+        if (item == NULL) {
+            Py_DECREF(rc);
+            rc = NULL;
+            break;
+        }
+        PyList_SET_ITEM(rc, i, item);
+    }
+
+    ecc_free_keypairs(keys, n);
+    ecc_free_state(state);
+
+    return rc;
+}
+
 
 static struct PyMethodDef _pyecc_methods[] = {
-    {"new_state", (PyCFunction)py_new_state, METH_NOARGS, new_state_doc},
+    {"new_state", (PyCFunction)py_new_state, METH_VARARGS, new_state_doc},
     {"new_keypair", (PyCFunction)py_new_keypair, METH_VARARGS, new_keypair_doc},
     {"verify", (PyCFunction)py_verify, METH_VARARGS, verify_doc},
     {"sign", (PyCFunction)py_sign, METH_VARARGS, sign_doc},
+    {"new_keypair_bin", (PyCFunction)py_new_keypair_bin, METH_VARARGS, new_keypair_bin_doc},
+    {"export_bin", (PyCFunction)py_export_bin, METH_VARARGS, export_bin_doc},
+    {"verify_bin", (PyCFunction)py_verify_bin, METH_VARARGS, verify_bin_doc},
+    {"sign_bin", (PyCFunction)py_sign_bin, METH_VARARGS, sign_bin_doc},
     {"encrypt", (PyCFunction)py_encrypt, METH_VARARGS, encrypt_doc},
     {"decrypt", (PyCFunction)py_decrypt, METH_VARARGS, decrypt_doc},
     {"keygen", (PyCFunction)(py_keygen), METH_NOARGS, keygen_doc},
+    {"keygen_many", (PyCFunction)(py_keygen_many), METH_VARARGS, keygen_many_doc},
     {NULL}
 };
 
 PyMODINIT_FUNC init_pyecc(void)
 {
+    /*
+     * The crypto calls above release the GIL so that several Python
+     * threads can use libseccure at the same time
+     */
+    PyEval_InitThreads();
     PyObject *module = Py_InitModule3("_pyecc", _pyecc_methods, pyecc_doc);
     PyModule_AddStringConstant(module, "DEFAULT_CURVE", DEFAULT_CURVE);
 }
@@ -26,13 +26,24 @@ class ECC(object):
         The ECC object must be instantiated to work with
         any encrypted data, as some amount of state is required
         at once
+
+        Passing legacy_mac=True lets decrypt() accept data from
+        older versions of encrypt(), whose MAC doesn't cover the
+        ciphertext and which may therefore have been tampered with
     '''
     def __init__(self, *args, **kwargs):
         self._private = kwargs.get('private')
         self._public = kwargs.get('public')
         self._curve = kwargs.get('curve')
-        self._state = _pyecc.new_state()
-        self._kp = _pyecc.new_keypair(self._public, self._private, self._state)
+        self._binary = kwargs.get('binary', False)
+        self._legacy_mac = kwargs.get('legacy_mac', False)
+        self._state = _pyecc.new_state(self._legacy_mac)
+        if self._binary:
+            self._kp = _pyecc.new_keypair_bin(self._public, self._private,
+                    self._state)
+        else:
+            self._kp = _pyecc.new_keypair(self._public, self._private,
+                    self._state)
 
     @classmethod
     def generate(cls):
@@ -41,6 +52,17 @@ class ECC(object):
             return cls(public=keys[0], private=keys[1], curve=keys[2])
         return None
 
+    @classmethod
+    def generate_many(cls, n, threads=1):
+        '''
+            Generate n keypairs at once, spread over `threads`
+            worker threads inside libseccure
+        '''
+        keys = _pyecc.keygen_many(n, threads)
+        if keys is None:
+            return None
+        return [cls(public=k[0], private=k[1], curve=k[2]) for k in keys]
+
 
     def encrypt(self, plaintext):
         return _pyecc.encrypt(plaintext, self._kp, self._state)
@@ -70,3 +92,19 @@ class ECC(object):
             return False
 
         return _pyecc.verify(data, signature, self._kp, self._state)
+
+    def sign_bin(self, data):
+        '''
+            Like sign(), but returns the raw binary signature
+        '''
+        return _pyecc.sign_bin(data, self._kp, self._state)
+
+    def verify_bin(self, data, signature):
+        return _pyecc.verify_bin(data, signature, self._kp, self._state)
+
+    def export_bin(self):
+        '''
+            Return the (public, private) keys in their binary form,
+            suitable for ECC(public=..., private=..., binary=True)
+        '''
+        return _pyecc.export_bin(self._kp, self._state)
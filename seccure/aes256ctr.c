@@ -38,6 +38,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 #include <gcrypt.h>
 
@@ -58,44 +60,143 @@ struct aes256ctr* aes256ctr_init(const char *key)
   if (gcry_err_code(err))
     goto error;
   
+  if (aes256ctr_rekey(ac, key))
+    return ac;
+
+  gcry_cipher_close(ac->ch);
+ error:
+  gcry_free(ac);
+  return NULL;
+}
+
+/* Opening a cipher handle costs more than encrypting a short message, so
+   long-lived users re-key an existing one instead                       */
+int aes256ctr_rekey(struct aes256ctr *ac, const char *key)
+{
+  gcry_error_t err;
+
   err = gcry_cipher_setkey(ac->ch, key, CIPHER_KEY_SIZE);
   if (gcry_err_code(err))
-    goto error;
+    return 0;
   
   err = gcry_cipher_setctr(ac->ch, NULL, 0);
   if (gcry_err_code(err))
-    goto error;
+    return 0;
 
+  memset(ac->buf, 0, CIPHER_BLOCK_SIZE);
   ac->idx = CIPHER_BLOCK_SIZE;
-  return ac;
+  return 1;
+}
 
- error:
-  gcry_free(ac);
-  return NULL;
+/* Encrypt the next counter block into the keystream buffer            */
+static void next_keystream_block(struct aes256ctr *ac)
+{
+  gcry_error_t err;
+
+  memset(ac->buf, 0, CIPHER_BLOCK_SIZE);
+  err = gcry_cipher_encrypt(ac->ch, ac->buf, CIPHER_BLOCK_SIZE, NULL, 0);
+  assert(! gcry_err_code(err));
+  (void)err;
+  ac->idx = 0;
+}
+
+/* XOR len bytes of a and b into out, a machine word at a time; out may be
+   the same buffer as a. Partial CTR blocks are never longer than 15
+   bytes, so at most one 8 and one 4 byte word and three bytes are left  */
+static void xor_bytes(char *out, const char *a, const char *b, int len)
+{
+  uint64_t x, y;
+  uint32_t u, v;
+
+  for(; len >= 8; len -= 8, out += 8, a += 8, b += 8) {
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+    x ^= y;
+    memcpy(out, &x, 8);
+  }
+  if (len >= 4) {
+    memcpy(&u, a, 4);
+    memcpy(&v, b, 4);
+    u ^= v;
+    memcpy(out, &u, 4);
+    len -= 4, out += 4, a += 4, b += 4;
+  }
+  for(; len; len--)
+    *out++ = *a++ ^ *b++;
 }
 
 void aes256ctr_enc(struct aes256ctr *ac, char *buf, int len)
 {
+  aes256ctr_enc_copy(ac, buf, buf, len);
+}
+
+/* aes256ctr_enc() from in to out, which must not overlap unless they are
+   the same buffer: the whole blocks go through a single gcry call that
+   reads in and writes out directly, saving the copy                      */
+void aes256ctr_enc_copy(struct aes256ctr *ac, char *out, const char *in, 
+			int len)
+{
+  const char *ks = (const char *)ac->buf;
   gcry_error_t err;
-  int full_blocks;
+  int n, full_blocks;
 
-  for(; len && (ac->idx < CIPHER_BLOCK_SIZE); len--)
-    *buf++ ^= ac->buf[ac->idx++];
+  n = CIPHER_BLOCK_SIZE - ac->idx;
+  if (n > len)
+    n = len;
+  xor_bytes(out, in, ks + ac->idx, n);
+  ac->idx += n;
+  out += n;
+  in += n;
+  len -= n;
 
   full_blocks = (len / CIPHER_BLOCK_SIZE) * CIPHER_BLOCK_SIZE;
-  err = gcry_cipher_encrypt(ac->ch, buf, full_blocks, NULL, 0);
-  assert(! gcry_err_code(err));
-  len -= full_blocks;
-  buf += full_blocks;
+  if (full_blocks) {
+    err = gcry_cipher_encrypt(ac->ch, out, full_blocks, in, full_blocks);
+    assert(! gcry_err_code(err));
+    (void)err;
+    len -= full_blocks;
+    out += full_blocks;
+    in += full_blocks;
+  }
 
   if (len) {
-    memset(ac->buf, 0, CIPHER_BLOCK_SIZE);
-    err = gcry_cipher_encrypt(ac->ch, ac->buf, CIPHER_BLOCK_SIZE, NULL, 0);
+    next_keystream_block(ac);
+    xor_bytes(out, in, ks, len);
+    ac->idx = len;
+  }
+}
+
+/* Write the next len bytes of keystream (the encryption of zeros) to buf
+   without XORing anything: leftover keystream is copied, whole blocks
+   are encrypted in buf itself                                          */
+void aes256ctr_keystream(struct aes256ctr *ac, char *buf, int len)
+{
+  const char *ks = (const char *)ac->buf;
+  gcry_error_t err;
+  int n, full_blocks;
+
+  n = CIPHER_BLOCK_SIZE - ac->idx;
+  if (n > len)
+    n = len;
+  memcpy(buf, ks + ac->idx, n);
+  ac->idx += n;
+  buf += n;
+  len -= n;
+
+  full_blocks = (len / CIPHER_BLOCK_SIZE) * CIPHER_BLOCK_SIZE;
+  if (full_blocks) {
+    memset(buf, 0, full_blocks);
+    err = gcry_cipher_encrypt(ac->ch, buf, full_blocks, NULL, 0);
     assert(! gcry_err_code(err));
-    ac->idx = 0;
-    
-    for(; len && (ac->idx < CIPHER_BLOCK_SIZE); len--)
-      *buf++ ^= ac->buf[ac->idx++];
+    (void)err;
+    len -= full_blocks;
+    buf += full_blocks;
+  }
+
+  if (len) {
+    next_keystream_block(ac);
+    memcpy(buf, ks, len);
+    ac->idx = len;
   }
 }
 
@@ -121,8 +222,37 @@ int hmacsha256_init(gcry_md_hd_t *mh, const char *key, int len)
   return ! gcry_err_code(err);
 }
 
-void aes256cprng_fillbuf(struct aes256cprng *cprng, char *buf, int len)
+int hmacsha256_rekey(gcry_md_hd_t mh, const char *key, int len)
+{
+  gcry_md_reset(mh);
+  return ! gcry_err_code(gcry_md_setkey(mh, key, len));
+}
+
+int aes256gcm_init(gcry_cipher_hd_t *ch, const char *key, const char *nonce)
+{
+  gcry_error_t err;
+
+  err = gcry_cipher_open(ch, GCRY_CIPHER_AES256, 
+			 GCRY_CIPHER_MODE_GCM, GCRY_CIPHER_SECURE);
+  if (gcry_err_code(err)) {
+    fprintf(stderr, "Error in aes256gcm_init(): %s\n", gcry_strerror(err));
+    return 0;
+  }
+
+  if (! aes256gcm_rekey(*ch, key, nonce)) {
+    gcry_cipher_close(*ch);
+    return 0;
+  }
+  return 1;
+}
+
+int aes256gcm_rekey(gcry_cipher_hd_t ch, const char *key, const char *nonce)
 {
-  memset(buf, 0, len);
-  aes256ctr_enc(cprng, buf, len);
+  gcry_error_t err;
+
+  gcry_cipher_reset(ch);
+  err = gcry_cipher_setkey(ch, key, CIPHER_KEY_SIZE);
+  if (! gcry_err_code(err))
+    err = gcry_cipher_setiv(ch, nonce, GCM_NONCE_SIZE);
+  return ! gcry_err_code(err);
 }
@@ -41,6 +41,7 @@
 #ifndef INC_AES256CTR_H
 #define INC_AES256CTR_H
 
+#include <stdint.h>
 #include <gcrypt.h>
 
 #define CIPHER_BLOCK_SIZE 16
@@ -48,22 +49,39 @@
 
 #define HMAC_KEY_SIZE 32
 
+/* buf holds the unused keystream of the current block from idx on; it is
+   declared as words so that it is aligned for the word-wide XOR        */
 struct aes256ctr {
   gcry_cipher_hd_t ch;
   int idx;
-  char buf[CIPHER_BLOCK_SIZE];
+  uint64_t buf[CIPHER_BLOCK_SIZE / sizeof(uint64_t)];
 };
 
 struct aes256ctr* aes256ctr_init(const char *key);
+int aes256ctr_rekey(struct aes256ctr *ac, const char *key);
 void aes256ctr_enc(struct aes256ctr *ac, char *buf, int len);
 #define aes256ctr_dec aes256ctr_enc
+void aes256ctr_enc_copy(struct aes256ctr *ac, char *out, const char *in, 
+			int len);
+#define aes256ctr_dec_copy aes256ctr_enc_copy
+void aes256ctr_keystream(struct aes256ctr *ac, char *buf, int len);
 void aes256ctr_done(struct aes256ctr *ac);
 
 int hmacsha256_init(gcry_md_hd_t *mh, const char *key, int len);
+int hmacsha256_rekey(gcry_md_hd_t mh, const char *key, int len);
+
+/* AES-256-GCM, the AEAD alternative to AES-256-CTR plus HMAC-SHA256: the
+   cipher key is the same as for CTR and the nonce is taken from the start
+   of the HMAC key, both being fresh for every ECIES message              */
+#define GCM_NONCE_SIZE 12
+#define GCM_TAG_SIZE 16
+
+int aes256gcm_init(gcry_cipher_hd_t *ch, const char *key, const char *nonce);
+int aes256gcm_rekey(gcry_cipher_hd_t ch, const char *key, const char *nonce);
 
 #define aes256cprng aes256ctr
 #define aes256cprng_init aes256ctr_init
-void aes256cprng_fillbuf(struct aes256cprng *cprng, char *buf, int len);
+#define aes256cprng_fillbuf aes256ctr_keystream
 #define aes256cprng_done aes256ctr_done
 
 #endif /* INC_AES256CTR_H */
@@ -39,6 +39,7 @@
 #include <gcrypt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "curves.h"
 #include "ecc.h"
@@ -48,10 +49,16 @@
 
 #define CURVE_NUM 8
 
+/* The serialization lengths only depend on m and the order, so they are
+   listed here instead of being derived with bignum arithmetic on every
+   load; enable the sanity checks in load_curve() to recompute them       */
 struct curve {
   const char *name, *a, *b, *m, *base_x, *base_y, *order;
   int cofactor;
-  int pk_len_compact;
+  int pk_len_bin, pk_len_compact;
+  int sig_len_bin, sig_len_compact;
+  int dh_len_bin, dh_len_compact;
+  int elem_len_bin, order_len_bin;
 };
 
 static const struct curve curves[CURVE_NUM] = {
@@ -62,7 +69,7 @@ static const struct curve curves[CURVE_NUM] = {
     "09487239995a5ee76b55f9c2f098",
     "a89ce5af8724c0a23e0e0ff77500", 
     "db7c2abf62e35e7628dfac6561c5", 
-    1, 18 },
+    1, 15, 18, 28, 35, 7, 9, 14, 14 },
   
   { "secp128r1",
     "fffffffdfffffffffffffffffffffffc", 
@@ -71,7 +78,7 @@ static const struct curve curves[CURVE_NUM] = {
     "161ff7528b899b2d0c28607ca52c5b86", 
     "cf5ac8395bafeb13c02da292dded7a83",
     "fffffffe0000000075a30d1b9038a115", 
-    1, 20 },
+    1, 17, 20, 32, 40, 8, 10, 16, 16 },
 
   { "secp160r1", 
     "ffffffffffffffffffffffffffffffff7ffffffc",
@@ -80,7 +87,7 @@ static const struct curve curves[CURVE_NUM] = {
     "4a96b5688ef573284664698968c38bb913cbfc82",
     "23a628553168947d59dcc912042351377ac5fb32",
     "0100000000000000000001f4c8f927aed3ca752257", 
-    1, 25 },
+    1, 21, 25, 41, 50, 10, 13, 20, 21 },
 
   { "secp192r1/nistp192",
     "fffffffffffffffffffffffffffffffefffffffffffffffc",
@@ -89,7 +96,7 @@ static const struct curve curves[CURVE_NUM] = {
     "188da80eb03090f67cbf20eb43a18800f4ff0afd82ff1012",
     "07192b95ffc8da78631011ed6b24cdd573f977a11e794811",
     "ffffffffffffffffffffffff99def836146bc9b1b4d22831", 
-    1, 30 },
+    1, 25, 30, 48, 60, 12, 15, 24, 24 },
 
   { "secp224r1/nistp224",
     "fffffffffffffffffffffffffffffffefffffffffffffffffffffffe",
@@ -98,7 +105,7 @@ static const struct curve curves[CURVE_NUM] = {
     "b70e0cbd6bb4bf7f321390b94a03c1d356c21122343280d6115c1d21",
     "bd376388b5f723fb4c22dfe6cd4375a05a07476444d5819985007e34",
     "ffffffffffffffffffffffffffff16a2e0b8f03e13dd29455c5c2a3d", 
-    1, 35 },
+    1, 29, 35, 56, 70, 14, 18, 28, 28 },
 
   { "secp256r1/nistp256",
     "ffffffff00000001000000000000000000000000fffffffffffffffffffffffc", 
@@ -107,7 +114,7 @@ static const struct curve curves[CURVE_NUM] = {
     "6b17d1f2e12c4247f8bce6e563a440f277037d812deb33a0f4a13945d898c296", 
     "4fe342e2fe1a7f9b8ee7eb4a7c0f9e162bce33576b315ececbb6406837bf51f5", 
     "ffffffff00000000ffffffffffffffffbce6faada7179e84f3b9cac2fc632551", 
-    1, 40 },
+    1, 33, 40, 64, 79, 16, 20, 32, 32 },
 
   { "secp384r1/nistp384",
     "fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffeffffffff0000000000000000fffffffc",
@@ -116,7 +123,7 @@ static const struct curve curves[CURVE_NUM] = {
     "aa87ca22be8b05378eb1c71ef320ad746e1d3b628ba79b9859f741e082542a385502f25dbf55296c3a545e3872760ab7",
     "3617de4a96262c6f5d9e98bf9292dc29f8f41dbd289a147ce9da3113b5f0b8c00a60b1ce1d7e819d7a431d7c90ea0e5f", 
     "ffffffffffffffffffffffffffffffffffffffffffffffffc7634d81f4372ddf581a0db248b0a77aecec196accc52973", 
-    1, 60 },
+    1, 49, 60, 96, 119, 24, 30, 48, 48 },
 
   { "secp521r1/nistp521",
     "1fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffc",
@@ -125,7 +132,7 @@ static const struct curve curves[CURVE_NUM] = {
     "0c6858e06b70404e9cd9e3ecb662395b4429c648139053fb521f828af606b4d3dbaa14b5e77efe75928fe1dc127a2ffa8de3348b3c1856a429bf97e7e31c2e5bd66",
     "11839296a789a3bc0045c8a5fb42c7d1bd998f54449579b446817afbd17273e662c97ee72995ef42640c550b9013fad0761353c7086a272c24088be94769fd16650",
     "1fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffa51868783bf2f966b7fcc0148f709a5d03bb5c9b8899c47aebb6fb71e91386409", 
-    1, 81 },
+    1, 66, 81, 131, 161, 32, 40, 66, 66 },
 };
 
 /******************************************************************************/
@@ -144,11 +151,21 @@ static struct curve_params* load_curve(const struct curve *c)
   gcry_mpi_t h;
   struct curve_params *cp;
   struct domain_params *dp;
+  int i;
 
   if (! (cp = malloc(sizeof(struct curve_params))))
     return NULL;
+  if (! (cp->precomp = malloc(sizeof(struct curve_precomp)))) {
+    free(cp);
+    return NULL;
+  }
 
   cp->name = c->name;
+  pthread_mutex_init(&cp->precomp->lock, NULL);
+  for(i = 0; i < PRECOMP_SLOTS; i++) {
+    cp->precomp->data[i] = NULL;
+    cp->precomp->release[i] = NULL;
+  }
 
   dp = &cp->dp;
   SCAN(&dp->a, c->a);
@@ -158,40 +175,65 @@ static struct curve_params* load_curve(const struct curve *c)
   SCAN(&dp->base.x, c->base_x);
   SCAN(&dp->base.y, c->base_y);
   dp->cofactor = c->cofactor;
+  dp->comb = comb_new();
+  if ((dp->field = field_new(dp->m, FIELD_ANY)))
+    fe_from_mpi(dp->fe_a, dp->a, dp->field);
 
   h = gcry_mpi_new(0);
 
+  gcry_mpi_add_ui(h, dp->a, 3);
+  dp->a_minus3 = ! gcry_mpi_cmp(h, dp->m);
+
+  cp->pk_len_bin = c->pk_len_bin;
+  cp->pk_len_compact = c->pk_len_compact;
+  cp->sig_len_bin = c->sig_len_bin;
+  cp->sig_len_compact = c->sig_len_compact;
+  cp->dh_len_bin = c->dh_len_bin;
+  cp->dh_len_compact = c->dh_len_compact;
+  cp->elem_len_bin = c->elem_len_bin;
+  cp->order_len_bin = c->order_len_bin;
+
+#if 0   /* enable this when adding a new curve to do some sanity checks */
+  if (! gcry_mpi_cmp_ui(dp->b, 0)) {
+    fprintf(stderr, "FATAL: b == 0\n");
+    exit(1);
+  }
+
+#define CHECK_LEN(field, x, df) do {					\
+    int len = get_serialization_len(x, df);				\
+    if (cp->field != len) {						\
+      fprintf(stderr, "FATAL: c->" #field " != %d\n", len);		\
+      exit(1);								\
+    }									\
+  } while (0)
+
   gcry_mpi_add(h, dp->m, dp->m);
   gcry_mpi_sub_ui(h, h, 1);
-  cp->pk_len_bin = get_serialization_len(h, DF_BIN);
-  cp->pk_len_compact = get_serialization_len(h, DF_COMPACT);
+  CHECK_LEN(pk_len_bin, h, DF_BIN);
+  CHECK_LEN(pk_len_compact, h, DF_COMPACT);
+  if (gcry_mpi_get_nbits(h) >= 8 * cp->pk_len_bin) {
+    fprintf(stderr, "FATAL: no room for ECIES_AEAD_FLAG\n");
+    exit(1);
+  }
 
   gcry_mpi_mul(h, dp->order, dp->order);
   gcry_mpi_sub_ui(h, h, 1);
-  cp->sig_len_bin = get_serialization_len(h, DF_BIN);
-  cp->sig_len_compact = get_serialization_len(h, DF_COMPACT);
-
-  cp->dh_len_bin = (gcry_mpi_get_nbits(dp->order) / 2 + 7) / 8;
-  if (cp->dh_len_bin > 32)
-    cp->dh_len_bin = 32;
+  CHECK_LEN(sig_len_bin, h, DF_BIN);
+  CHECK_LEN(sig_len_compact, h, DF_COMPACT);
 
+  int dh_len_bin = (gcry_mpi_get_nbits(dp->order) / 2 + 7) / 8;
+  if (cp->dh_len_bin != (dh_len_bin > 32 ? 32 : dh_len_bin)) {
+    fprintf(stderr, "FATAL: wrong c->dh_len_bin\n");
+    exit(1);
+  }
   gcry_mpi_set_ui(h, 0);
   gcry_mpi_set_bit(h, 8 * cp->dh_len_bin);
   gcry_mpi_sub_ui(h, h, 1);
-  cp->dh_len_compact = get_serialization_len(h, DF_COMPACT);
+  CHECK_LEN(dh_len_compact, h, DF_COMPACT);
 
-  cp->elem_len_bin = get_serialization_len(dp->m, DF_BIN);
-  cp->order_len_bin = get_serialization_len(dp->order, DF_BIN);
+  CHECK_LEN(elem_len_bin, dp->m, DF_BIN);
+  CHECK_LEN(order_len_bin, dp->order, DF_BIN);
 
-#if 0   /* enable this when adding a new curve to do some sanity checks */
-  if (! gcry_mpi_cmp_ui(dp->b, 0)) {
-    fprintf(stderr, "FATAL: b == 0\n");
-    exit(1);
-  }
-  if (cp->pk_len_compact != c->pk_len_compact) {
-    fprintf(stderr, "FATAL: c->pk_len_compact != %d\n", cp->pk_len_compact);
-    exit(1);
-  }
   if (! point_on_curve(&dp->base, dp)) {
     fprintf(stderr, "FATAL: base point not on curve!\n");
     exit(1);
@@ -218,34 +260,109 @@ static struct curve_params* load_curve(const struct curve *c)
   return cp;
 }
 
-struct curve_params* curve_by_name(const char *name)
+static void free_curve(struct curve_params *cp)
+{
+  struct domain_params *dp = &cp->dp;
+  int i;
+  for(i = 0; i < PRECOMP_SLOTS; i++)
+    if (cp->precomp->data[i])
+      cp->precomp->release[i](cp->precomp->data[i]);
+  pthread_mutex_destroy(&cp->precomp->lock);
+  free(cp->precomp);
+  gcry_mpi_release(dp->a);
+  gcry_mpi_release(dp->b);
+  gcry_mpi_release(dp->m);
+  gcry_mpi_release(dp->order);
+  gcry_mpi_release(dp->base.x);
+  gcry_mpi_release(dp->base.y);
+  if (dp->comb)
+    comb_release(dp->comb);
+  if (dp->field)
+    field_release(dp->field);
+  free(cp);
+}
+
+/******************************************************************************/
+
+/* Parsing the curve constants and computing the serialization lengths is
+   done once per curve. Curves stay loaded when their last reference is
+   dropped, curve_registry_cleanup() frees the unreferenced ones.            */
+
+static struct curve_params *registry[CURVE_NUM];
+static int registry_refs[CURVE_NUM];
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const struct curve_params* curve_get(int i)
+{
+  struct curve_params *cp;
+  pthread_mutex_lock(&registry_lock);
+  if (! registry[i])
+    registry[i] = load_curve(&curves[i]);
+  if ((cp = registry[i]))
+    registry_refs[i]++;
+  pthread_mutex_unlock(&registry_lock);
+  return cp;
+}
+
+const struct curve_params* curve_by_name(const char *name)
 {
   const struct curve *c = curves;
   int i;
   for(i = 0; i < CURVE_NUM; i++, c++)
     if (strstr(c->name, name))
-      return load_curve(c);
+      return curve_get(i);
   return NULL;
 }
 
-struct curve_params* curve_by_pk_len_compact(int len)
+const struct curve_params* curve_by_pk_len_compact(int len)
 {
   const struct curve *c = curves;
   int i;
   for(i = 0; i < CURVE_NUM; i++, c++)
     if (c->pk_len_compact == len)
-      return load_curve(c);
+      return curve_get(i);
   return NULL;
 }
 
-void curve_release(struct curve_params *cp)
+void curve_release(const struct curve_params *cp)
 {
-  struct domain_params *dp = &cp->dp;
-  gcry_mpi_release(dp->a);
-  gcry_mpi_release(dp->b);
-  gcry_mpi_release(dp->m);
-  gcry_mpi_release(dp->order);
-  gcry_mpi_release(dp->base.x);
-  gcry_mpi_release(dp->base.y);
-  free(cp);
+  int i;
+  pthread_mutex_lock(&registry_lock);
+  for(i = 0; i < CURVE_NUM; i++)
+    if (registry[i] == cp && registry_refs[i] > 0) {
+      registry_refs[i]--;
+      break;
+    }
+  pthread_mutex_unlock(&registry_lock);
+}
+
+void curve_registry_cleanup(void)
+{
+  int i;
+  pthread_mutex_lock(&registry_lock);
+  for(i = 0; i < CURVE_NUM; i++)
+    if (registry[i] && ! registry_refs[i]) {
+      free_curve(registry[i]);
+      registry[i] = NULL;
+    }
+  pthread_mutex_unlock(&registry_lock);
+}
+
+/* Returns the data in the given slot of the curve, calling build() to
+   compute it if this is the first request. The data is released with the
+   curve, and must not be modified once built. Returns NULL if build() fails,
+   in which case the next call tries again.                                   */
+void* curve_precomp(const struct curve_params *cp, 
+		    enum curve_precomp_slot slot,
+		    void* (*build)(const struct curve_params *cp),
+		    void (*release)(void *data))
+{
+  struct curve_precomp *pc = cp->precomp;
+  void *data;
+  pthread_mutex_lock(&pc->lock);
+  if (! pc->data[slot] && (pc->data[slot] = build(cp)))
+    pc->release[slot] = release;
+  data = pc->data[slot];
+  pthread_mutex_unlock(&pc->lock);
+  return data;
 }
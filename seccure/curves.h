@@ -40,8 +40,23 @@
 #ifndef INC_CURVES_H
 #define INC_CURVES_H
 
+#include <pthread.h>
+
 #include "ecc.h"
 
+/* Data derived from a curve that is computed on first use and then shared
+   by all users of the curve, see curve_precomp()                             */
+enum curve_precomp_slot {
+  PRECOMP_BASE_WNAF,
+  PRECOMP_SLOTS
+};
+
+struct curve_precomp {
+  pthread_mutex_t lock;
+  void *data[PRECOMP_SLOTS];
+  void (*release[PRECOMP_SLOTS])(void *data);
+};
+
 struct curve_params {
   const char *name;
   struct domain_params dp;
@@ -49,10 +64,19 @@ struct curve_params {
   int sig_len_bin, sig_len_compact;
   int dh_len_bin, dh_len_compact;
   int elem_len_bin, order_len_bin;
+  struct curve_precomp *precomp;
 };
 
-struct curve_params* curve_by_name(const char *name);
-struct curve_params* curve_by_pk_len_compact(int len);
-void curve_release(struct curve_params *cp);
+/* Curves are loaded once per process and shared; every curve_by_*() that
+   returns a curve must be paired with a curve_release()                      */
+const struct curve_params* curve_by_name(const char *name);
+const struct curve_params* curve_by_pk_len_compact(int len);
+void curve_release(const struct curve_params *cp);
+void curve_registry_cleanup(void);
+
+void* curve_precomp(const struct curve_params *cp, 
+		    enum curve_precomp_slot slot,
+		    void* (*build)(const struct curve_params *cp),
+		    void (*release)(void *data));
 
 #endif /* INC_CURVES_H */
@@ -38,9 +38,12 @@
 
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <gcrypt.h>
 
 #include "ecc.h"
+#include "field.h"
 #include "numtheory.h"
 
 /******************************************************************************/
@@ -126,6 +129,7 @@ int point_decompress(struct affine_point *p, const gcry_mpi_t x, int yflag,
 	gcry_mpi_sub(p->y, dp->m, y);
     rc = point_on_curve(p, dp);
     assert(rc);
+    (void)rc;
     }
   gcry_mpi_release(h);
   gcry_mpi_release(y);
@@ -233,20 +237,52 @@ int jacobian_is_zero(const struct jacobian_point *p)
   return ! gcry_mpi_cmp_ui(p->z, 0);
 }
 
-void jacobian_double(struct jacobian_point *p, const struct domain_params *dp)
+/* The temporaries are allocated once per multiplication with room for a
+   double length product, so the formulae below never allocate              */
+struct jacobian_scratch jacobian_scratch_new(const struct domain_params *dp)
+{
+  struct jacobian_scratch s;
+  unsigned int nbits = 2 * gcry_mpi_get_nbits(dp->m);
+  s.t1 = gcry_mpi_snew(nbits);
+  s.t2 = gcry_mpi_snew(nbits);
+  s.t3 = gcry_mpi_snew(nbits);
+  s.t4 = gcry_mpi_snew(nbits);
+  return s;
+}
+
+void jacobian_scratch_release(struct jacobian_scratch *s)
+{
+  gcry_mpi_release(s->t1);
+  gcry_mpi_release(s->t2);
+  gcry_mpi_release(s->t3);
+  gcry_mpi_release(s->t4);
+}
+
+/* Algorithm 3.21 in the "Guide to Elliptic Curve Cryptography" when a = -3,
+   which saves two squarings over the general formula                        */
+void jacobian_double(struct jacobian_point *p, struct jacobian_scratch *s,
+		     const struct domain_params *dp)
 {
   if (gcry_mpi_cmp_ui(p->z, 0)) {
     if (gcry_mpi_cmp_ui(p->y, 0)) {
-      gcry_mpi_t t1, t2;
-      t1 = gcry_mpi_snew(0);
-      t2 = gcry_mpi_snew(0);
-      gcry_mpi_mulm(t1, p->x, p->x, dp->m);
-      gcry_mpi_addm(t2, t1, t1, dp->m);
-      gcry_mpi_addm(t2, t2, t1, dp->m);
-      gcry_mpi_mulm(t1, p->z, p->z, dp->m);
-      gcry_mpi_mulm(t1, t1, t1, dp->m);
-      gcry_mpi_mulm(t1, t1, dp->a, dp->m);
-      gcry_mpi_addm(t1, t1, t2, dp->m);
+      gcry_mpi_t t1 = s->t1, t2 = s->t2;
+      if (dp->a_minus3) {
+	gcry_mpi_mulm(t1, p->z, p->z, dp->m);
+	gcry_mpi_subm(t2, p->x, t1, dp->m);
+	gcry_mpi_addm(t1, p->x, t1, dp->m);
+	gcry_mpi_mulm(t2, t2, t1, dp->m);
+	gcry_mpi_addm(t1, t2, t2, dp->m);
+	gcry_mpi_addm(t1, t1, t2, dp->m);
+      }
+      else {
+	gcry_mpi_mulm(t1, p->x, p->x, dp->m);
+	gcry_mpi_addm(t2, t1, t1, dp->m);
+	gcry_mpi_addm(t2, t2, t1, dp->m);
+	gcry_mpi_mulm(t1, p->z, p->z, dp->m);
+	gcry_mpi_mulm(t1, t1, t1, dp->m);
+	gcry_mpi_mulm(t1, t1, dp->a, dp->m);
+	gcry_mpi_addm(t1, t1, t2, dp->m);
+      }
       gcry_mpi_mulm(p->z, p->z, p->y, dp->m);
       gcry_mpi_addm(p->z, p->z, p->z, dp->m);
       gcry_mpi_mulm(p->y, p->y, p->y, dp->m);
@@ -261,8 +297,6 @@ void jacobian_double(struct jacobian_point *p, const struct domain_params *dp)
       gcry_mpi_mulm(t2, p->y, p->y, dp->m);
       gcry_mpi_addm(t2, t2, t2, dp->m);
       gcry_mpi_subm(p->y, t1, t2, dp->m);
-      gcry_mpi_release(t1);
-      gcry_mpi_release(t2);
     }
     else
       gcry_mpi_set_ui(p->z, 0);
@@ -271,25 +305,23 @@ void jacobian_double(struct jacobian_point *p, const struct domain_params *dp)
 
 void jacobian_affine_point_add(struct jacobian_point *p1, 
 			       const struct affine_point *p2,
+			       struct jacobian_scratch *s,
 			       const struct domain_params *dp)
 {
   if (! point_is_zero(p2)) {
     if (gcry_mpi_cmp_ui(p1->z, 0)) {
-      gcry_mpi_t t1, t2, t3;
-      t1 = gcry_mpi_snew(0);
-      t2 = gcry_mpi_snew(0);
+      gcry_mpi_t t1 = s->t1, t2 = s->t2, t3 = s->t3;
       gcry_mpi_mulm(t1, p1->z, p1->z, dp->m);
       gcry_mpi_mulm(t2, t1, p2->x, dp->m);
       gcry_mpi_mulm(t1, t1, p1->z, dp->m);
       gcry_mpi_mulm(t1, t1, p2->y, dp->m);
       if (! gcry_mpi_cmp(p1->x, t2)) {
 	if (! gcry_mpi_cmp(p1->y, t1))
-	  jacobian_double(p1, dp);
+	  jacobian_double(p1, s, dp);
 	else
 	  jacobian_load_zero(p1);
       }
       else {
-	t3 = gcry_mpi_snew(0);
 	gcry_mpi_subm(p1->x, p1->x, t2, dp->m);
 	gcry_mpi_subm(p1->y, p1->y, t1, dp->m);
 	gcry_mpi_mulm(p1->z, p1->z, p1->x, dp->m);
@@ -304,16 +336,41 @@ void jacobian_affine_point_add(struct jacobian_point *p1,
 	gcry_mpi_subm(t2, t2, p1->x, dp->m);
 	gcry_mpi_mulm(p1->y, p1->y, t2, dp->m);
 	gcry_mpi_subm(p1->y, p1->y, t1, dp->m);
-	gcry_mpi_release(t3);
       }
-      gcry_mpi_release(t1);
-      gcry_mpi_release(t2);
     }
     else
       jacobian_load_affine(p1, p2);
   }
 }
 
+/* Co-Z addition with update (Meloni): p1 and p2 share their z coordinate,
+   r becomes p1 + p2 and p1 is rescaled to the z coordinate of r. The
+   caller makes sure p1 != +-p2.                                              */
+static void jacobian_coz_add(struct jacobian_point *r, 
+			     struct jacobian_point *p1,
+			     const struct jacobian_point *p2,
+			     struct jacobian_scratch *s,
+			     const struct domain_params *dp)
+{
+  gcry_mpi_t t1 = s->t1, t2 = s->t2, t3 = s->t3, t4 = s->t4;
+  gcry_mpi_subm(t1, p2->x, p1->x, dp->m);
+  gcry_mpi_mulm(r->z, p1->z, t1, dp->m);
+  gcry_mpi_mulm(t1, t1, t1, dp->m);
+  gcry_mpi_mulm(t2, p1->x, t1, dp->m);
+  gcry_mpi_mulm(t3, p2->x, t1, dp->m);
+  gcry_mpi_subm(t4, p2->y, p1->y, dp->m);
+  gcry_mpi_mulm(r->x, t4, t4, dp->m);
+  gcry_mpi_subm(r->x, r->x, t2, dp->m);
+  gcry_mpi_subm(r->x, r->x, t3, dp->m);
+  gcry_mpi_subm(t3, t3, t2, dp->m);
+  gcry_mpi_mulm(p1->y, p1->y, t3, dp->m);
+  gcry_mpi_set(p1->x, t2);
+  gcry_mpi_set(p1->z, r->z);
+  gcry_mpi_subm(t2, t2, r->x, dp->m);
+  gcry_mpi_mulm(r->y, t4, t2, dp->m);
+  gcry_mpi_subm(r->y, r->y, p1->y, dp->m);
+}
+
 struct affine_point jacobian_to_affine(const struct jacobian_point *p,
 				       const struct domain_params *dp)
 {
@@ -331,6 +388,224 @@ struct affine_point jacobian_to_affine(const struct jacobian_point *p,
   return r;
 }
 
+/* Converts n points with Montgomery's simultaneous inversion, i.e. a single
+   inversion and 3(n - 1) multiplications; the caller provides the allocated
+   output points                                                              */
+void jacobian_to_affine_batch(struct affine_point *r,
+				     const struct jacobian_point *p, int n,
+				     const struct domain_params *dp)
+{
+  gcry_mpi_t z[n], h[n];
+  int i;
+  memset(z, 0, sizeof(z));
+  memset(h, 0, sizeof(h));
+  for(i = 0; i < n; i++) {
+    z[i] = p[i].z;
+    h[i] = gcry_mpi_snew(0);
+  }
+  mod_inv_batch(h, z, n, dp->m);
+  for(i = 0; i < n; i++) {
+    point_load_zero(&r[i]);
+    if (gcry_mpi_cmp_ui(p[i].z, 0)) {
+      gcry_mpi_mulm(r[i].y, h[i], h[i], dp->m);
+      gcry_mpi_mulm(r[i].x, p[i].x, r[i].y, dp->m);
+      gcry_mpi_mulm(r[i].y, r[i].y, h[i], dp->m);
+      gcry_mpi_mulm(r[i].y, r[i].y, p[i].y, dp->m);
+    }
+    gcry_mpi_release(h[i]);
+  }
+}
+
+/******************************************************************************/
+
+/* The Jacobian formulae above on the fixed size field elements of field.c.
+   Curves whose prime has a special form run their scalar multiplications
+   on these, converting from and to gcrypt MPIs only at the boundaries.      */
+
+static void fe_point_load(struct fe_affine *r, const struct affine_point *p,
+			  const struct field *f)
+{
+  fe_from_mpi(r->x, p->x, f);
+  fe_from_mpi(r->y, p->y, f);
+}
+
+static void fe_points_load(struct fe_affine *r, const struct affine_point *p,
+			   int n, const struct field *f)
+{
+  int i;
+  for(i = 0; i < n; i++)
+    fe_point_load(&r[i], &p[i], f);
+}
+
+static int fe_point_is_zero(const struct fe_affine *p, const struct field *f)
+{
+  return fe_is_zero(p->x, f) && fe_is_zero(p->y, f);
+}
+
+static void fe_jacobian_load_affine(struct fe_jacobian *p1,
+				    const struct fe_affine *p2,
+				    const struct field *f)
+{
+  if (! fe_point_is_zero(p2, f)) {
+    fe_set(p1->x, p2->x, f);
+    fe_set(p1->y, p2->y, f);
+    fe_set(p1->z, f->one, f);
+  }
+  else
+    fe_load_zero(p1->z, f);
+}
+
+static void fe_jacobian_double(struct fe_jacobian *p, 
+			       const struct domain_params *dp)
+{
+  const struct field *f = dp->field;
+  if (! fe_is_zero(p->z, f)) {
+    if (! fe_is_zero(p->y, f)) {
+      fe_t t1, t2;
+      if (dp->a_minus3) {
+	fe_sqr(t1, p->z, f);
+	fe_sub(t2, p->x, t1, f);
+	fe_add(t1, p->x, t1, f);
+	fe_mul(t2, t2, t1, f);
+	fe_add(t1, t2, t2, f);
+	fe_add(t1, t1, t2, f);
+      }
+      else {
+	fe_sqr(t1, p->x, f);
+	fe_add(t2, t1, t1, f);
+	fe_add(t2, t2, t1, f);
+	fe_sqr(t1, p->z, f);
+	fe_sqr(t1, t1, f);
+	fe_mul(t1, t1, dp->fe_a, f);
+	fe_add(t1, t1, t2, f);
+      }
+      fe_mul(p->z, p->z, p->y, f);
+      fe_add(p->z, p->z, p->z, f);
+      fe_sqr(p->y, p->y, f);
+      fe_add(p->y, p->y, p->y, f);
+      fe_mul(t2, p->x, p->y, f);
+      fe_add(t2, t2, t2, f);
+      fe_sqr(p->x, t1, f);
+      fe_sub(p->x, p->x, t2, f);
+      fe_sub(p->x, p->x, t2, f);
+      fe_sub(t2, t2, p->x, f);
+      fe_mul(t1, t1, t2, f);
+      fe_sqr(t2, p->y, f);
+      fe_add(t2, t2, t2, f);
+      fe_sub(p->y, t1, t2, f);
+    }
+    else
+      fe_load_zero(p->z, f);
+  }
+}
+
+static void fe_jacobian_affine_point_add(struct fe_jacobian *p1,
+					 const struct fe_affine *p2,
+					 const struct domain_params *dp)
+{
+  const struct field *f = dp->field;
+  if (! fe_point_is_zero(p2, f)) {
+    if (! fe_is_zero(p1->z, f)) {
+      fe_t t1, t2, t3;
+      fe_sqr(t1, p1->z, f);
+      fe_mul(t2, t1, p2->x, f);
+      fe_mul(t1, t1, p1->z, f);
+      fe_mul(t1, t1, p2->y, f);
+      if (fe_equal(p1->x, t2, f)) {
+	if (fe_equal(p1->y, t1, f))
+	  fe_jacobian_double(p1, dp);
+	else
+	  fe_load_zero(p1->z, f);
+      }
+      else {
+	fe_sub(p1->x, p1->x, t2, f);
+	fe_sub(p1->y, p1->y, t1, f);
+	fe_mul(p1->z, p1->z, p1->x, f);
+	fe_sqr(t3, p1->x, f);
+	fe_mul(t2, t2, t3, f);
+	fe_mul(t3, t3, p1->x, f);
+	fe_mul(t1, t1, t3, f);
+	fe_sqr(p1->x, p1->y, f);
+	fe_sub(p1->x, p1->x, t3, f);
+	fe_sub(p1->x, p1->x, t2, f);
+	fe_sub(p1->x, p1->x, t2, f);
+	fe_sub(t2, t2, p1->x, f);
+	fe_mul(p1->y, p1->y, t2, f);
+	fe_sub(p1->y, p1->y, t1, f);
+      }
+    }
+    else
+      fe_jacobian_load_affine(p1, p2, f);
+  }
+}
+
+/* As jacobian_coz_add()                                                      */
+static void fe_jacobian_coz_add(struct fe_jacobian *r, struct fe_jacobian *p1,
+				const struct fe_jacobian *p2,
+				const struct field *f)
+{
+  fe_t t1, t2, t3, t4;
+  fe_sub(t1, p2->x, p1->x, f);
+  fe_mul(r->z, p1->z, t1, f);
+  fe_sqr(t1, t1, f);
+  fe_mul(t2, p1->x, t1, f);
+  fe_mul(t3, p2->x, t1, f);
+  fe_sub(t4, p2->y, p1->y, f);
+  fe_sqr(r->x, t4, f);
+  fe_sub(r->x, r->x, t2, f);
+  fe_sub(r->x, r->x, t3, f);
+  fe_sub(t3, t3, t2, f);
+  fe_mul(p1->y, p1->y, t3, f);
+  fe_set(p1->x, t2, f);
+  fe_set(p1->z, r->z, f);
+  fe_sub(t2, t2, r->x, f);
+  fe_mul(r->y, t4, t2, f);
+  fe_sub(r->y, r->y, p1->y, f);
+}
+
+/* Converts n points sharing a single inversion, see mod_inv_batch()        */
+static void fe_jacobian_to_affine_batch(struct fe_affine *r,
+					const struct fe_jacobian *p, int n,
+					const struct field *f)
+{
+  fe_t prod[n], u, h;
+  int i;
+  fe_set(u, f->one, f);
+  for(i = 0; i < n; i++) {
+    if (! fe_is_zero(p[i].z, f))
+      fe_mul(u, u, p[i].z, f);
+    fe_set(prod[i], u, f);
+  }
+  fe_inv(u, u, f);
+  for(i = n - 1; i >= 0; i--) {
+    if (fe_is_zero(p[i].z, f)) {
+      fe_load_zero(r[i].x, f);
+      fe_load_zero(r[i].y, f);
+      continue;
+    }
+    if (i)
+      fe_mul(h, u, prod[i - 1], f);
+    else
+      fe_set(h, u, f);
+    fe_mul(u, u, p[i].z, f);
+    fe_sqr(r[i].y, h, f);
+    fe_mul(r[i].x, p[i].x, r[i].y, f);
+    fe_mul(r[i].y, r[i].y, h, f);
+    fe_mul(r[i].y, r[i].y, p[i].y, f);
+  }
+}
+
+static struct affine_point fe_jacobian_to_affine(const struct fe_jacobian *p,
+						 const struct domain_params *dp)
+{
+  struct affine_point r = point_new();
+  struct fe_affine h;
+  fe_jacobian_to_affine_batch(&h, p, 1, dp->field);
+  fe_to_mpi(r.x, h.x, dp->field);
+  fe_to_mpi(r.y, h.y, dp->field);
+  return r;
+}
+
 /******************************************************************************/
 
 /* Algorithm 3.27 in the "Guide to Elliptic Curve Cryptography"               */
@@ -358,23 +633,589 @@ struct affine_point pointmul(const struct affine_point *p,
 			     const gcry_mpi_t exp, 
 			     const struct domain_params *dp)
 {
-  struct jacobian_point r = jacobian_new();
+  if (p == &dp->base && dp->comb &&
+      gcry_mpi_get_nbits(exp) <= gcry_mpi_get_nbits(dp->order) &&
+      comb_precompute(dp->comb, dp))
+    return pointmul_comb(exp, dp);
+  return pointmul_wnaf(p, exp, dp);
+}
+
+#endif
+
+/******************************************************************************/
+
+/* The digit schedules and accumulators of the loops below are derived from
+   secret scalars (private keys, ECDSA nonces) and are cleared before their
+   memory is given back. The stores go through a volatile pointer so that
+   they are not dropped as dead like a memset() right before a return.       */
+
+static void wipe(void *p, size_t len)
+{
+  volatile unsigned char *b = p;
+  size_t i;
+  for(i = 0; i < len; i++)
+    b[i] = 0;
+}
+
+/* Main loop shared by the comb, wNAF and joint multiplications: for i from
+   len - 1 down to 0 the accumulator is doubled and tab[t][idx[t][i]] added
+   for every table t whose index is not negative                             */
+
+static void chain_run(struct jacobian_point *r, int len, int ntab, 
+		      const struct affine_point *const *tab,
+		      signed char *const *idx, struct jacobian_scratch *s,
+		      const struct domain_params *dp)
+{
+  int i, t;
+  jacobian_load_zero(r);
+  for(i = len - 1; i >= 0; i--) {
+    jacobian_double(r, s, dp);
+    for(t = 0; t < ntab; t++)
+      if (idx[t][i] >= 0)
+	jacobian_affine_point_add(r, &tab[t][(int)idx[t][i]], s, dp);
+  }
+}
+
+static void fe_chain_run(struct fe_jacobian *r, int len, int ntab, 
+			 const struct fe_affine *const *tab,
+			 signed char *const *idx,
+			 const struct domain_params *dp)
+{
+  int i, t;
+  fe_load_zero(r->z, dp->field);
+  for(i = len - 1; i >= 0; i--) {
+    fe_jacobian_double(r, dp);
+    for(t = 0; t < ntab; t++)
+      if (idx[t][i] >= 0)
+	fe_jacobian_affine_point_add(r, &tab[t][(int)idx[t][i]], dp);
+  }
+}
+
+static struct affine_point chain(int len, int ntab, 
+				 const struct affine_point *const *tab,
+				 signed char *const *idx,
+				 const struct domain_params *dp)
+{
   struct affine_point R;
-  int n = gcry_mpi_get_nbits(exp);
+  struct jacobian_point r;
+  struct jacobian_scratch s;
   int rc = 0;
-  while (n) {
-    jacobian_double(&r, dp);
-    if (gcry_mpi_test_bit(exp, --n))
-      jacobian_affine_point_add(&r, p, dp);
-  }
+  r = jacobian_new();
+  s = jacobian_scratch_new(dp);
+  chain_run(&r, len, ntab, tab, idx, &s, dp);
   R = jacobian_to_affine(&r, dp);
+  jacobian_scratch_release(&s);
   jacobian_release(&r);
   rc = point_on_curve(&R, dp);
   assert(rc);
+  (void)rc;
   return R;
 }
 
-#endif
+static struct affine_point fe_chain(int len, int ntab, 
+				    const struct fe_affine *const *tab,
+				    signed char *const *idx,
+				    const struct domain_params *dp)
+{
+  struct affine_point R;
+  struct fe_jacobian r;
+  int rc = 0;
+  fe_chain_run(&r, len, ntab, tab, idx, dp);
+  R = fe_jacobian_to_affine(&r, dp);
+  wipe(&r, sizeof(r));
+  rc = point_on_curve(&R, dp);
+  assert(rc);
+  (void)rc;
+  return R;
+}
+
+/******************************************************************************/
+
+/* Algorithm 3.44 in the "Guide to Elliptic Curve Cryptography"               */
+
+#define COMB_WIDTH 5
+
+struct comb_table* comb_new(void)
+{
+  struct comb_table *ct;
+  if (! (ct = malloc(sizeof(struct comb_table))))
+    return NULL;
+  pthread_mutex_init(&ct->lock, NULL);
+  ct->built = 0;
+  ct->width = COMB_WIDTH;
+  ct->d = 0;
+  ct->table = NULL;
+  ct->fe_table = NULL;
+  return ct;
+}
+
+void comb_release(struct comb_table *ct)
+{
+  int i;
+  if (ct->table) {
+    for(i = 0; i < (1 << ct->width); i++)
+      point_release(&ct->table[i]);
+    free(ct->table);
+  }
+  free(ct->fe_table);
+  pthread_mutex_destroy(&ct->lock);
+  free(ct);
+}
+
+/* The table only holds multiples of the public base point, so keep it out
+   of the (small) secure memory pool                                          */
+static void comb_store(struct affine_point *p, const struct jacobian_point *r,
+		       const struct domain_params *dp)
+{
+  struct affine_point h = jacobian_to_affine(r, dp);
+  p->x = gcry_mpi_new(0);
+  p->y = gcry_mpi_new(0);
+  point_set(p, &h);
+  point_release(&h);
+}
+
+/* table[a] = a_{w-1} 2^{(w-1)d} P + ... + a_1 2^d P + a_0 P                  */
+static int comb_build(struct comb_table *ct, const struct domain_params *dp)
+{
+  struct affine_point pow[COMB_WIDTH];
+  struct jacobian_point r;
+  struct jacobian_scratch s;
+  int i, j, n = 1 << ct->width;
+  if (! (ct->table = malloc(n * sizeof(struct affine_point))))
+    return 0;
+  ct->d = (gcry_mpi_get_nbits(dp->order) + ct->width - 1) / ct->width;
+  r = jacobian_new();
+  s = jacobian_scratch_new(dp);
+  jacobian_load_affine(&r, &dp->base);
+  comb_store(&pow[0], &r, dp);
+  for(i = 1; i < ct->width; i++) {
+    for(j = 0; j < ct->d; j++)
+      jacobian_double(&r, &s, dp);
+    comb_store(&pow[i], &r, dp);
+  }
+  ct->table[0].x = gcry_mpi_new(0);
+  ct->table[0].y = gcry_mpi_new(0);
+  for(i = 1; i < n; i++) {
+    for(j = ct->width - 1; ! (i & (1 << j)); j--);
+    jacobian_load_affine(&r, &ct->table[i & ~(1 << j)]);
+    jacobian_affine_point_add(&r, &pow[j], &s, dp);
+    comb_store(&ct->table[i], &r, dp);
+  }
+  for(i = 0; i < ct->width; i++)
+    point_release(&pow[i]);
+  jacobian_scratch_release(&s);
+  jacobian_release(&r);
+  if (dp->field && (ct->fe_table = malloc(n * sizeof(struct fe_affine))))
+    fe_points_load(ct->fe_table, ct->table, n, dp->field);
+  return 1;
+}
+
+/* The table is shared by all users of the curve, so the first caller builds
+   it under the lock while concurrent ones wait                               */
+int comb_precompute(struct comb_table *ct, const struct domain_params *dp)
+{
+  int built;
+  pthread_mutex_lock(&ct->lock);
+  if (! ct->built)
+    ct->built = comb_build(ct, dp);
+  built = ct->built;
+  pthread_mutex_unlock(&ct->lock);
+  return built;
+}
+
+static void comb_schedule(signed char *idx, const gcry_mpi_t exp,
+			  const struct comb_table *ct)
+{
+  int i, j, k;
+  for(i = 0; i < ct->d; i++) {
+    for(k = 0, j = ct->width - 1; j >= 0; j--)
+      k = (k << 1) | gcry_mpi_test_bit(exp, j * ct->d + i);
+    idx[i] = k ? k : -1;
+  }
+}
+
+struct affine_point pointmul_comb(const gcry_mpi_t exp, 
+				  const struct domain_params *dp)
+{
+  const struct comb_table *ct = dp->comb;
+  signed char idx[ct->d], *sched = idx;
+  struct affine_point R;
+  assert(ct->built);
+  comb_schedule(idx, exp, ct);
+  if (ct->fe_table) {
+    const struct fe_affine *tab = ct->fe_table;
+    R = fe_chain(ct->d, 1, &tab, &sched, dp);
+  }
+  else {
+    const struct affine_point *tab = ct->table;
+    R = chain(ct->d, 1, &tab, &sched, dp);
+  }
+  wipe(idx, sizeof(idx));
+  return R;
+}
+
+/* r[i] = exp[i] * base for n exponents, with all results brought to affine
+   coordinates by jacobian_to_affine_batch() or its field element version    */
+static int fe_comb_batch(struct affine_point *r, const gcry_mpi_t *exp, 
+			 int n, const struct domain_params *dp)
+{
+  const struct comb_table *ct = dp->comb;
+  const struct fe_affine *tab = ct->fe_table;
+  signed char idx[ct->d], *sched = idx;
+  struct fe_jacobian *jr;
+  struct fe_affine *ar;
+  int i;
+  if (! (jr = malloc(n * sizeof(struct fe_jacobian))))
+    return 0;
+  if (! (ar = malloc(n * sizeof(struct fe_affine)))) {
+    free(jr);
+    return 0;
+  }
+  for(i = 0; i < n; i++) {
+    comb_schedule(idx, exp[i], ct);
+    fe_chain_run(&jr[i], ct->d, 1, &tab, &sched, dp);
+  }
+  fe_jacobian_to_affine_batch(ar, jr, n, dp->field);
+  for(i = 0; i < n; i++) {
+    r[i] = point_new();
+    fe_to_mpi(r[i].x, ar[i].x, dp->field);
+    fe_to_mpi(r[i].y, ar[i].y, dp->field);
+  }
+  wipe(idx, sizeof(idx));
+  wipe(jr, n * sizeof(struct fe_jacobian));
+  wipe(ar, n * sizeof(struct fe_affine));
+  free(jr);
+  free(ar);
+  return 1;
+}
+
+static int comb_batch(struct affine_point *r, const gcry_mpi_t *exp, 
+		      int n, const struct domain_params *dp)
+{
+  const struct comb_table *ct = dp->comb;
+  const struct affine_point *tab = ct->table;
+  signed char idx[ct->d], *sched = idx;
+  struct jacobian_point *jr;
+  struct jacobian_scratch s;
+  int i;
+  if (! (jr = calloc(n, sizeof(struct jacobian_point))))
+    return 0;
+  s = jacobian_scratch_new(dp);
+  for(i = 0; i < n; i++) {
+    jr[i] = jacobian_new();
+    comb_schedule(idx, exp[i], ct);
+    chain_run(&jr[i], ct->d, 1, &tab, &sched, &s, dp);
+    r[i] = point_new();
+  }
+  jacobian_to_affine_batch(r, jr, n, dp);
+  for(i = 0; i < n; i++)
+    jacobian_release(&jr[i]);
+  jacobian_scratch_release(&s);
+  wipe(idx, sizeof(idx));
+  free(jr);
+  return 1;
+}
+
+/* r[i] = exp[i] * base for i < n, converting all results with a single
+   inversion when the comb method applies                                     */
+void pointmul_base_batch(struct affine_point *r, const gcry_mpi_t *exp, 
+			 int n, const struct domain_params *dp)
+{
+  int i, comb, rc = 0;
+  comb = dp->comb && comb_precompute(dp->comb, dp);
+  for(i = 0; comb && i < n; i++)
+    comb = gcry_mpi_get_nbits(exp[i]) <= gcry_mpi_get_nbits(dp->order);
+  if (! comb || ! (dp->comb->fe_table ? fe_comb_batch(r, exp, n, dp) :
+		   comb_batch(r, exp, n, dp)))
+    for(i = 0; i < n; i++)
+      r[i] = pointmul(&dp->base, exp[i], dp);
+  for(i = 0; i < n; i++) {
+    rc = point_on_curve(&r[i], dp);
+    assert(rc);
+    (void)rc;
+  }
+}
+
+/******************************************************************************/
+
+/* Algorithms 3.35 and 3.36 in the "Guide to Elliptic Curve Cryptography"     */
+
+#define WNAF_WIDTH 5
+
+static int wnaf_recode(signed char *naf, const gcry_mpi_t exp)
+{
+  gcry_mpi_t k;
+  int d, j, len = 0;
+  k = gcry_mpi_snew(0);
+  gcry_mpi_set(k, exp);
+  while (gcry_mpi_cmp_ui(k, 0) > 0) {
+    d = 0;
+    if (gcry_mpi_test_bit(k, 0)) {
+      for(j = WNAF_WIDTH - 1; j >= 0; j--)
+	d = (d << 1) | gcry_mpi_test_bit(k, j);
+      if (d >= 1 << (WNAF_WIDTH - 1)) {
+	d -= 1 << WNAF_WIDTH;
+	gcry_mpi_add_ui(k, k, -d);
+      }
+      else
+	gcry_mpi_sub_ui(k, k, d);
+    }
+    naf[len++] = d;
+    gcry_mpi_rshift(k, k, 1);
+  }
+  gcry_mpi_release(k);
+  return len;
+}
+
+#define WNAF_TABLE_SIZE (1 << (WNAF_WIDTH - 2))
+
+/* tab[i] = (2i + 1) P and tab[n + i] = -(2i + 1) P. As in the comb table the
+   multiples of P are not secret and are kept out of the secure memory pool,
+   which otherwise slows down every temporary allocated in the main loop.
+   P is brought to the z coordinate of 2P and the odd multiples follow by
+   co-Z additions; P has large prime order, so none of them hits the
+   exceptional cases.                                                         */
+static void wnaf_precompute(struct affine_point *tab, 
+			    const struct affine_point *p,
+			    const struct domain_params *dp)
+{
+  struct jacobian_point jtab[WNAF_TABLE_SIZE], d;
+  struct jacobian_scratch s;
+  int i, n = WNAF_TABLE_SIZE;
+  d = jacobian_new();
+  s = jacobian_scratch_new(dp);
+  for(i = 0; i < n; i++) {
+    jtab[i].x = gcry_mpi_new(0);
+    jtab[i].y = gcry_mpi_new(0);
+    jtab[i].z = gcry_mpi_new(0);
+    tab[i].x = gcry_mpi_new(0);
+    tab[i].y = gcry_mpi_new(0);
+  }
+  if (! point_is_zero(p)) {
+    jacobian_load_affine(&d, p);
+    jacobian_double(&d, &s, dp);
+    gcry_mpi_mulm(s.t1, d.z, d.z, dp->m);
+    gcry_mpi_mulm(jtab[0].x, p->x, s.t1, dp->m);
+    gcry_mpi_mulm(s.t1, s.t1, d.z, dp->m);
+    gcry_mpi_mulm(jtab[0].y, p->y, s.t1, dp->m);
+    gcry_mpi_set(jtab[0].z, d.z);
+    for(i = 1; i < n; i++)
+      jacobian_coz_add(&jtab[i], &d, &jtab[i - 1], &s, dp);
+  }
+  jacobian_scratch_release(&s);
+  jacobian_release(&d);
+  jacobian_to_affine_batch(tab, jtab, n, dp);
+  for(i = 0; i < n; i++) {
+    jacobian_release(&jtab[i]);
+    tab[n + i].x = gcry_mpi_new(0);
+    tab[n + i].y = gcry_mpi_new(0);
+    gcry_mpi_set(tab[n + i].x, tab[i].x);
+    if (gcry_mpi_cmp_ui(tab[i].y, 0))
+      gcry_mpi_sub(tab[n + i].y, dp->m, tab[i].y);
+  }
+}
+
+static void wnaf_release(struct affine_point *tab)
+{
+  int i;
+  for(i = 0; i < 2 * WNAF_TABLE_SIZE; i++)
+    point_release(&tab[i]);
+}
+
+/* As wnaf_precompute(), directly on field elements                          */
+static void fe_wnaf_precompute(struct fe_affine *tab,
+			       const struct affine_point *p,
+			       const struct domain_params *dp)
+{
+  const struct field *f = dp->field;
+  struct fe_jacobian jtab[WNAF_TABLE_SIZE], d;
+  struct fe_affine P;
+  fe_t zero, t;
+  int i, n = WNAF_TABLE_SIZE;
+  fe_point_load(&P, p, f);
+  if (fe_point_is_zero(&P, f)) {
+    for(i = 0; i < 2 * n; i++)
+      tab[i] = P;
+    return;
+  }
+  fe_jacobian_load_affine(&d, &P, f);
+  fe_jacobian_double(&d, dp);
+  fe_sqr(t, d.z, f);
+  fe_mul(jtab[0].x, P.x, t, f);
+  fe_mul(t, t, d.z, f);
+  fe_mul(jtab[0].y, P.y, t, f);
+  fe_set(jtab[0].z, d.z, f);
+  for(i = 1; i < n; i++)
+    fe_jacobian_coz_add(&jtab[i], &d, &jtab[i - 1], f);
+  fe_jacobian_to_affine_batch(tab, jtab, n, f);
+  fe_load_zero(zero, f);
+  for(i = 0; i < n; i++) {
+    fe_set(tab[n + i].x, tab[i].x, f);
+    fe_sub(tab[n + i].y, zero, tab[i].y, f);
+  }
+}
+
+/* Recodes exp into the table indices of its digits, -1 standing for a zero
+   digit; idx is padded with -1 up to len >= nbits(exp) + 1 positions        */
+static void wnaf_schedule(signed char *idx, int len, const gcry_mpi_t exp)
+{
+  int i, n;
+  n = wnaf_recode(idx, exp);
+  for(i = 0; i < len; i++)
+    if (i >= n || ! idx[i])
+      idx[i] = -1;
+    else if (idx[i] > 0)
+      idx[i] = idx[i] >> 1;
+    else
+      idx[i] = WNAF_TABLE_SIZE + (-idx[i] >> 1);
+}
+
+/* Heap allocated wNAF table for points that are multiplied repeatedly.
+   With a field the multiples are only kept as field elements, so that
+   pointmul_wnaf_precomp() doesn't convert them back on every call          */
+struct wnaf_table* wnaf_table_new(const struct affine_point *p,
+				  const struct domain_params *dp)
+{
+  struct wnaf_table *tab;
+  int n = 2 * WNAF_TABLE_SIZE;
+  if (! (tab = malloc(sizeof(struct wnaf_table))))
+    return NULL;
+  tab->table = NULL;
+  tab->fe_table = NULL;
+  if (dp->field) {
+    if (! (tab->fe_table = malloc(n * sizeof(struct fe_affine)))) {
+      free(tab);
+      return NULL;
+    }
+    fe_wnaf_precompute(tab->fe_table, p, dp);
+  }
+  else {
+    if (! (tab->table = malloc(n * sizeof(struct affine_point)))) {
+      free(tab);
+      return NULL;
+    }
+    wnaf_precompute(tab->table, p, dp);
+  }
+  tab->point = point_new();
+  point_set(&tab->point, p);
+  return tab;
+}
+
+void wnaf_table_release(struct wnaf_table *tab)
+{
+  point_release(&tab->point);
+  if (tab->table) {
+    wnaf_release(tab->table);
+    free(tab->table);
+  }
+  free(tab->fe_table);
+  free(tab);
+}
+
+/* exp * P for the table of P, on field elements if ftab is given           */
+static struct affine_point wnaf_chain(const struct affine_point *tab,
+				      const struct fe_affine *ftab,
+				      const gcry_mpi_t exp, 
+				      const struct domain_params *dp)
+{
+  int len = gcry_mpi_get_nbits(exp) + 1;
+  signed char idx[len], *sched = idx;
+  struct affine_point R;
+  wnaf_schedule(idx, len, exp);
+  if (ftab)
+    R = fe_chain(len, 1, &ftab, &sched, dp);
+  else
+    R = chain(len, 1, &tab, &sched, dp);
+  wipe(idx, sizeof(idx));
+  return R;
+}
+
+struct affine_point pointmul_wnaf_precomp(const struct wnaf_table *tab,
+					  const gcry_mpi_t exp, 
+					  const struct domain_params *dp)
+{
+  return wnaf_chain(tab->table, tab->fe_table, exp, dp);
+}
+
+struct affine_point pointmul_wnaf(const struct affine_point *p,
+				  const gcry_mpi_t exp, 
+				  const struct domain_params *dp)
+{
+  struct affine_point tab[2 * WNAF_TABLE_SIZE], R;
+  if (dp->field) {
+    struct fe_affine ftab[2 * WNAF_TABLE_SIZE];
+    fe_wnaf_precompute(ftab, p, dp);
+    return wnaf_chain(NULL, ftab, exp, dp);
+  }
+  wnaf_precompute(tab, p, dp);
+  R = wnaf_chain(tab, NULL, exp, dp);
+  wnaf_release(tab);
+  return R;
+}
+
+/* Algorithm 3.51 in the "Guide to Elliptic Curve Cryptography": both
+   exponents share a single chain of doublings. The tables are on field
+   elements if ftab is given                                                 */
+static struct affine_point joint_chain(const struct affine_point *const *tab,
+				       const struct fe_affine *const *ftab,
+				       const gcry_mpi_t exp1,
+				       const gcry_mpi_t exp2,
+				       const struct domain_params *dp)
+{
+  int len1 = gcry_mpi_get_nbits(exp1), len2 = gcry_mpi_get_nbits(exp2);
+  int len = (len1 > len2 ? len1 : len2) + 1;
+  signed char idx1[len], idx2[len], *sched[2] = { idx1, idx2 };
+  struct affine_point R;
+  wnaf_schedule(idx1, len, exp1);
+  wnaf_schedule(idx2, len, exp2);
+  if (ftab)
+    R = fe_chain(len, 2, ftab, sched, dp);
+  else
+    R = chain(len, 2, tab, sched, dp);
+  wipe(idx1, sizeof(idx1));
+  wipe(idx2, sizeof(idx2));
+  return R;
+}
+
+struct affine_point pointmul_joint_precomp(const struct wnaf_table *tab1,
+					   const gcry_mpi_t exp1,
+					   const struct wnaf_table *tab2,
+					   const gcry_mpi_t exp2,
+					   const struct domain_params *dp)
+{
+  assert(! tab1->fe_table == ! tab2->fe_table);
+  if (tab1->fe_table) {
+    const struct fe_affine *t[2] = { tab1->fe_table, tab2->fe_table };
+    return joint_chain(NULL, t, exp1, exp2, dp);
+  }
+  else {
+    const struct affine_point *t[2] = { tab1->table, tab2->table };
+    return joint_chain(t, NULL, exp1, exp2, dp);
+  }
+}
+
+struct affine_point pointmul_joint(const struct affine_point *p1,
+				   const gcry_mpi_t exp1,
+				   const struct affine_point *p2,
+				   const gcry_mpi_t exp2,
+				   const struct domain_params *dp)
+{
+  struct affine_point tab1[2 * WNAF_TABLE_SIZE], tab2[2 * WNAF_TABLE_SIZE], R;
+  const struct affine_point *t[2] = { tab1, tab2 };
+  if (dp->field) {
+    struct fe_affine ftab1[2 * WNAF_TABLE_SIZE], ftab2[2 * WNAF_TABLE_SIZE];
+    const struct fe_affine *ft[2] = { ftab1, ftab2 };
+    fe_wnaf_precompute(ftab1, p1, dp);
+    fe_wnaf_precompute(ftab2, p2, dp);
+    return joint_chain(NULL, ft, exp1, exp2, dp);
+  }
+  wnaf_precompute(tab1, p1, dp);
+  wnaf_precompute(tab2, p2, dp);
+  R = joint_chain(t, NULL, exp1, exp2, dp);
+  wnaf_release(tab1);
+  wnaf_release(tab2);
+  return R;
+}
 
 /******************************************************************************/
 
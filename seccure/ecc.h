@@ -42,6 +42,9 @@
 #define INC_ECC_H
 
 #include <gcrypt.h>
+#include <pthread.h>
+
+#include "field.h"
 
 struct affine_point {
   gcry_mpi_t x, y;
@@ -51,10 +54,45 @@ struct jacobian_point {
   gcry_mpi_t x, y, z;
 };
 
+/* Temporaries of the Jacobian formulae, reused across a multiplication     */
+struct jacobian_scratch {
+  gcry_mpi_t t1, t2, t3, t4;
+};
+
+/* The same points over the fixed size field elements of field.h            */
+struct fe_affine {
+  fe_t x, y;
+};
+
+struct fe_jacobian {
+  fe_t x, y, z;
+};
+
+/* Precomputed table for the fixed-base comb method, filled on first use   */
+struct comb_table {
+  pthread_mutex_t lock;
+  int built;
+  int width, d;
+  struct affine_point *table;
+  struct fe_affine *fe_table;
+};
+
+/* Odd multiples of a point for the wNAF method, see wnaf_table_new(). They
+   are kept in fe_table if the curve has a field and in table otherwise     */
+struct wnaf_table {
+  struct affine_point point;
+  struct affine_point *table;
+  struct fe_affine *fe_table;
+};
+
 struct domain_params {
   gcry_mpi_t a, b, m, order;
   struct affine_point base;
   int cofactor;
+  struct comb_table *comb;
+  int a_minus3;               /* a = -3 (mod m) */
+  struct field *field;        /* NULL if m has no special form */
+  fe_t fe_a;
 };
 
 struct affine_point point_new(void);
@@ -78,17 +116,53 @@ void jacobian_load_affine(struct jacobian_point *p1,
 			  const struct affine_point *p2);
 void jacobian_load_zero(struct jacobian_point *p);
 int jacobian_is_zero(const struct jacobian_point *p);
-void jacobian_double(struct jacobian_point *p, const struct domain_params *dp);
+struct jacobian_scratch jacobian_scratch_new(const struct domain_params *dp);
+void jacobian_scratch_release(struct jacobian_scratch *s);
+void jacobian_double(struct jacobian_point *p, struct jacobian_scratch *s,
+		     const struct domain_params *dp);
 void jacobian_affine_point_add(struct jacobian_point *p1, 
 			       const struct affine_point *p2,
+			       struct jacobian_scratch *s,
 			       const struct domain_params *dp);
 struct affine_point jacobian_to_affine(const struct jacobian_point *p,
 				       const struct domain_params *dp);
-
+void jacobian_to_affine_batch(struct affine_point *r,
+			      const struct jacobian_point *p, int n,
+			      const struct domain_params *dp);
+
+
+struct comb_table* comb_new(void);
+void comb_release(struct comb_table *ct);
+int comb_precompute(struct comb_table *ct, const struct domain_params *dp);
+struct affine_point pointmul_comb(const gcry_mpi_t exp, 
+				  const struct domain_params *dp);
+
+struct wnaf_table* wnaf_table_new(const struct affine_point *p,
+				  const struct domain_params *dp);
+void wnaf_table_release(struct wnaf_table *tab);
+struct affine_point pointmul_wnaf_precomp(const struct wnaf_table *tab,
+					  const gcry_mpi_t exp, 
+					  const struct domain_params *dp);
+struct affine_point pointmul_wnaf(const struct affine_point *p,
+				  const gcry_mpi_t exp, 
+				  const struct domain_params *dp);
+
+struct affine_point pointmul_joint_precomp(const struct wnaf_table *tab1,
+					   const gcry_mpi_t exp1,
+					   const struct wnaf_table *tab2,
+					   const gcry_mpi_t exp2,
+					   const struct domain_params *dp);
+struct affine_point pointmul_joint(const struct affine_point *p1,
+				   const gcry_mpi_t exp1,
+				   const struct affine_point *p2,
+				   const gcry_mpi_t exp2,
+				   const struct domain_params *dp);
 
 struct affine_point pointmul(const struct affine_point *p,
 			     const gcry_mpi_t exp, 
 			     const struct domain_params *dp);
+void pointmul_base_batch(struct affine_point *r, const gcry_mpi_t *exp, 
+			 int n, const struct domain_params *dp);
 
 
 int embedded_key_validation(const struct affine_point *p,
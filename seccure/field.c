@@ -0,0 +1,530 @@
+/*
+ *  seccure  -  Copyright 2009 B. Poettering
+ *
+ *  Maintained by R. Tyler Ballance <tyler@slide.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* 
+ *   SECCURE Elliptic Curve Crypto Utility for Reliable Encryption
+ *
+ * Current homepage: http://slideinc.github.com/PyECC
+ * Original homepage: http://point-at-infinity.org/seccure/
+ *
+ *
+ * seccure implements a selection of asymmetric algorithms based on  
+ * elliptic curve cryptography (ECC). See the manpage or the project's  
+ * homepage for further details.
+ *
+ * This code links against the GNU gcrypt library "libgcrypt" (which
+ * is part of the GnuPG project). Use the included Makefile to build
+ * the binary.
+ * 
+ * Report bugs to: http://github.com/rtyler/PyECC/issues
+ */
+
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gcrypt.h>
+
+#include "field.h"
+
+/******************************************************************************/
+
+/* Multiprecision primitives on little endian limb vectors                    */
+
+#ifdef __SIZEOF_INT128__
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+static inline uint64_t mul_add(uint64_t *hi, uint64_t a, uint64_t b, 
+			       uint64_t c, uint64_t d)
+{
+  uint128_t t = (uint128_t)a * b + c + d;
+  *hi = t >> 64;
+  return t;
+}
+
+#else
+
+static inline uint64_t mul_add(uint64_t *hi, uint64_t a, uint64_t b, 
+			       uint64_t c, uint64_t d)
+{
+  uint64_t a0 = a & 0xffffffff, a1 = a >> 32;
+  uint64_t b0 = b & 0xffffffff, b1 = b >> 32;
+  uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+  uint64_t mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+  uint64_t lo = (mid << 32) | (p00 & 0xffffffff);
+  uint64_t h = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+  lo += c;
+  h += lo < c;
+  lo += d;
+  h += lo < d;
+  *hi = h;
+  return lo;
+}
+
+#endif
+
+static uint64_t limbs_add(uint64_t *r, const uint64_t *a, const uint64_t *b, 
+			  int n)
+{
+  uint64_t s, carry = 0;
+  int i;
+  for(i = 0; i < n; i++) {
+    s = a[i] + carry;
+    carry = s < carry;
+    r[i] = s + b[i];
+    carry += r[i] < s;
+  }
+  return carry;
+}
+
+static uint64_t limbs_sub(uint64_t *r, const uint64_t *a, const uint64_t *b, 
+			  int n)
+{
+  uint64_t d, s, borrow = 0;
+  int i;
+  for(i = 0; i < n; i++) {
+    s = b[i];
+    d = a[i] - borrow;
+    borrow = a[i] < borrow;
+    r[i] = d - s;
+    borrow += d < s;
+  }
+  return borrow;
+}
+
+static int limbs_cmp(const uint64_t *a, const uint64_t *b, int n)
+{
+  while (n--)
+    if (a[n] != b[n])
+      return a[n] > b[n] ? 1 : -1;
+  return 0;
+}
+
+/* Algorithm 2.9 in the "Guide to Elliptic Curve Cryptography"                */
+static void limbs_mul(uint64_t *t, const uint64_t *a, const uint64_t *b, 
+		      int n)
+{
+  uint64_t carry;
+  int i, j;
+  for(i = 0; i < n; i++)
+    t[i] = 0;
+  for(i = 0; i < n; i++) {
+    carry = 0;
+    for(j = 0; j < n; j++)
+      t[i + j] = mul_add(&carry, a[i], b[j], t[i + j], carry);
+    t[i + n] = carry;
+  }
+}
+
+/* Algorithm 2.13 in the "Guide to Elliptic Curve Cryptography": the cross
+   products are computed once and doubled                                    */
+static void limbs_sqr(uint64_t *t, const uint64_t *a, int n)
+{
+  uint64_t carry, hi;
+  int i, j;
+  for(i = 0; i < 2 * n; i++)
+    t[i] = 0;
+  for(i = 0; i < n; i++) {
+    carry = 0;
+    for(j = i + 1; j < n; j++)
+      t[i + j] = mul_add(&carry, a[i], a[j], t[i + j], carry);
+    t[i + n] = carry;
+  }
+  for(i = 2 * n - 1; i >= 0; i--)
+    t[i] = (t[i] << 1) | (i ? t[i - 1] >> 63 : 0);
+  for(carry = 0, i = 0; i < n; i++) {
+    t[2 * i] = mul_add(&hi, a[i], a[i], t[2 * i], carry);
+    t[2 * i + 1] += hi;
+    carry = t[2 * i + 1] < hi;
+  }
+}
+
+static void limbs_from_mpi(uint64_t *r, int n, const gcry_mpi_t x)
+{
+  unsigned char buf[8 * FE_LIMBS];
+  size_t len, i;
+  gcry_error_t err;
+  err = gcry_mpi_print(GCRYMPI_FMT_USG, buf, sizeof(buf), &len, x);
+  assert(! err && len <= 8 * (size_t)n);
+  (void)err;
+  for(i = 0; i < (size_t)n; i++)
+    r[i] = 0;
+  for(i = 0; i < len; i++)
+    r[i / 8] |= (uint64_t)buf[len - 1 - i] << (8 * (i % 8));
+  memset(buf, 0, sizeof(buf));
+}
+
+/******************************************************************************/
+
+/* Algorithms 2.27 to 2.30 in the "Guide to Elliptic Curve Cryptography":
+   with the product split into 32 bit words c_k, every word of the result
+   is a small signed combination of them. words_reduce() propagates the
+   carries, folding the final carry back in via 2^(32n) = delta (mod p).      */
+
+static void words_reduce(fe_t r, int64_t *acc, const struct field *f)
+{
+  int64_t carry;
+  int i, n = f->words;
+  for(;;) {
+    for(carry = 0, i = 0; i < n; i++) {
+      acc[i] += carry;
+      carry = acc[i] >> 32;
+      acc[i] &= 0xffffffff;
+    }
+    if (! carry)
+      break;
+    for(i = 0; i < n; i++)
+      acc[i] += carry * f->delta[i];
+  }
+  for(i = 0; i < f->limbs; i++)
+    r[i] = 0;
+  for(i = 0; i < n; i++)
+    r[i / 2] |= (uint64_t)acc[i] << (32 * (i & 1));
+  if (limbs_cmp(r, f->p, f->limbs) >= 0)
+    limbs_sub(r, r, f->p, f->limbs);
+}
+
+#define C(i) ((int64_t)(uint32_t)(t[(i) / 2] >> (32 * ((i) & 1))))
+
+static void reduce_p192(fe_t r, const uint64_t *t, const struct field *f)
+{
+  int64_t acc[6];
+  acc[0] = C(0) + C(6) + C(10);
+  acc[1] = C(1) + C(7) + C(11);
+  acc[2] = C(2) + C(6) + C(8) + C(10);
+  acc[3] = C(3) + C(7) + C(9) + C(11);
+  acc[4] = C(4) + C(8) + C(10);
+  acc[5] = C(5) + C(9) + C(11);
+  words_reduce(r, acc, f);
+}
+
+static void reduce_p224(fe_t r, const uint64_t *t, const struct field *f)
+{
+  int64_t acc[7];
+  acc[0] = C(0) - C(7) - C(11);
+  acc[1] = C(1) - C(8) - C(12);
+  acc[2] = C(2) - C(9) - C(13);
+  acc[3] = C(3) + C(7) + C(11) - C(10);
+  acc[4] = C(4) + C(8) + C(12) - C(11);
+  acc[5] = C(5) + C(9) + C(13) - C(12);
+  acc[6] = C(6) + C(10) - C(13);
+  words_reduce(r, acc, f);
+}
+
+static void reduce_p256(fe_t r, const uint64_t *t, const struct field *f)
+{
+  int64_t acc[8];
+  acc[0] = C(0) + C(8) + C(9) - C(11) - C(12) - C(13) - C(14);
+  acc[1] = C(1) + C(9) + C(10) - C(12) - C(13) - C(14) - C(15);
+  acc[2] = C(2) + C(10) + C(11) - C(13) - C(14) - C(15);
+  acc[3] = C(3) + 2 * C(11) + 2 * C(12) + C(13) - C(15) - C(8) - C(9);
+  acc[4] = C(4) + 2 * C(12) + 2 * C(13) + C(14) - C(9) - C(10);
+  acc[5] = C(5) + 2 * C(13) + 2 * C(14) + C(15) - C(10) - C(11);
+  acc[6] = C(6) + 3 * C(14) + 2 * C(15) + C(13) - C(8) - C(9);
+  acc[7] = C(7) + 3 * C(15) + C(8) - C(10) - C(11) - C(12) - C(13);
+  words_reduce(r, acc, f);
+}
+
+static void reduce_p384(fe_t r, const uint64_t *t, const struct field *f)
+{
+  int64_t acc[12];
+  acc[0] = C(0) + C(12) + C(21) + C(20) - C(23);
+  acc[1] = C(1) + C(13) + C(22) + C(23) - C(12) - C(20);
+  acc[2] = C(2) + C(14) + C(23) - C(13) - C(21);
+  acc[3] = C(3) + C(15) + C(12) + C(20) + C(21) - C(14) - C(22) - C(23);
+  acc[4] = C(4) + 2 * C(21) + C(16) + C(13) + C(12) + C(20) + C(22) - C(15)
+    - 2 * C(23);
+  acc[5] = C(5) + 2 * C(22) + C(17) + C(14) + C(13) + C(21) + C(23) - C(16);
+  acc[6] = C(6) + 2 * C(23) + C(18) + C(15) + C(14) + C(22) - C(17);
+  acc[7] = C(7) + C(19) + C(16) + C(15) + C(23) - C(18);
+  acc[8] = C(8) + C(20) + C(17) + C(16) - C(19);
+  acc[9] = C(9) + C(21) + C(18) + C(17) - C(20);
+  acc[10] = C(10) + C(22) + C(19) + C(18) - C(21);
+  acc[11] = C(11) + C(23) + C(20) + C(19) - C(22);
+  words_reduce(r, acc, f);
+}
+
+#undef C
+
+/* Algorithm 2.31 in the "Guide to Elliptic Curve Cryptography": for the
+   Mersenne prime p = 2^k - 1 the high part of c is simply added to the low
+   part.                                                                     */
+static void reduce_mersenne(fe_t r, const uint64_t *t, const struct field *f)
+{
+  uint64_t high[FE_LIMBS];
+  int i, q = f->bits / 64, s = f->bits % 64;
+  for(i = 0; i < f->limbs; i++) {
+    high[i] = t[q + i] >> s;
+    if (s)
+      high[i] |= t[q + i + 1] << (64 - s);
+    r[i] = t[i];
+  }
+  if (s)
+    r[q] &= ((uint64_t)1 << s) - 1;
+  limbs_add(r, r, high, f->limbs);
+  if (limbs_cmp(r, f->p, f->limbs) >= 0)
+    limbs_sub(r, r, f->p, f->limbs);
+}
+
+/* Montgomery reduction (Algorithm 14.32 in the "Handbook of Applied
+   Cryptography") for primes without special form: elements are kept as
+   a R mod p with R = 2^(64 limbs), the product of two of them is reduced
+   to a b R mod p by adding multiples of p that clear the low limbs.          */
+static void reduce_montgomery(fe_t r, const uint64_t *t, 
+			      const struct field *f)
+{
+  uint64_t a[2 * FE_LIMBS + 1], u, carry;
+  int i, j, n = f->limbs;
+  memcpy(a, t, 2 * n * sizeof(uint64_t));
+  a[2 * n] = 0;
+  for(i = 0; i < n; i++) {
+    u = a[i] * f->pinv;
+    carry = 0;
+    for(j = 0; j < n; j++)
+      a[i + j] = mul_add(&carry, u, f->p[j], a[i + j], carry);
+    for(j = i + n; carry; j++) {
+      a[j] += carry;
+      carry = a[j] < carry;
+    }
+  }
+  if (a[2 * n] || limbs_cmp(a + n, f->p, n) >= 0)
+    limbs_sub(r, a + n, f->p, n);
+  else
+    memcpy(r, a + n, n * sizeof(uint64_t));
+}
+
+static void setup_montgomery(struct field *f, const gcry_mpi_t p)
+{
+  uint64_t inv = 1;
+  gcry_mpi_t h;
+  int i;
+  for(i = 0; i < 6; i++)
+    inv *= 2 - f->p[0] * inv;
+  f->pinv = -inv;
+  h = gcry_mpi_new(0);
+  gcry_mpi_set_ui(h, 0);
+  gcry_mpi_set_bit(h, 64 * f->limbs);
+  gcry_mpi_mod(h, h, p);
+  limbs_from_mpi(f->one, FE_LIMBS, h);
+  gcry_mpi_mulm(h, h, h, p);
+  limbs_from_mpi(f->r2, FE_LIMBS, h);
+  gcry_mpi_release(h);
+  f->reduce = reduce_montgomery;
+  f->montgomery = 1;
+}
+
+static const struct {
+  const char *p;
+  void (*reduce)(fe_t r, const uint64_t *t, const struct field *f);
+} nist_primes[] = {
+  { "fffffffffffffffffffffffffffffffeffffffffffffffff", reduce_p192 },
+  { "ffffffffffffffffffffffffffffffff000000000000000000000001", reduce_p224 },
+  { "ffffffff00000001000000000000000000000000ffffffffffffffffffffffff",
+    reduce_p256 },
+  { "fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffe"
+    "ffffffff0000000000000000ffffffff", reduce_p384 },
+};
+
+#define NIST_PRIMES (sizeof(nist_primes) / sizeof(nist_primes[0]))
+
+/* Writes delta = 2^(32n) - p with signed words, all of them in {-1, 0, 1}
+   for the primes above                                                       */
+static void setup_delta(struct field *f, const gcry_mpi_t p)
+{
+  uint64_t d[FE_LIMBS];
+  int64_t v, carry;
+  gcry_mpi_t delta;
+  int i;
+  delta = gcry_mpi_new(0);
+  gcry_mpi_set_ui(delta, 0);
+  gcry_mpi_set_bit(delta, 32 * f->words);
+  gcry_mpi_sub(delta, delta, p);
+  limbs_from_mpi(d, f->limbs, delta);
+  gcry_mpi_release(delta);
+  for(carry = 0, i = 0; i < f->words; i++) {
+    v = (int64_t)((d[i / 2] >> (32 * (i & 1))) & 0xffffffff) + carry;
+    carry = v > 0x80000000LL;
+    f->delta[i] = carry ? v - 0x100000000LL : v;
+  }
+}
+
+static int is_prime(const gcry_mpi_t p, const char *hex)
+{
+  gcry_mpi_t h;
+  int res;
+  gcry_mpi_scan(&h, GCRYMPI_FMT_HEX, (const unsigned char *)hex, 0, NULL);
+  res = ! gcry_mpi_cmp(p, h);
+  gcry_mpi_release(h);
+  return res;
+}
+
+/* With FIELD_ANY the fast reduction is used for the Mersenne and NIST
+   primes and Montgomery multiplication for all others. Returns NULL if
+   the prime is too large or does not support the requested representation.  */
+struct field* field_new(const gcry_mpi_t p, enum field_repr repr)
+{
+  struct field *f;
+  gcry_mpi_t h;
+  int i, mersenne;
+
+  if (! (f = malloc(sizeof(struct field))))
+    return NULL;
+  f->bits = gcry_mpi_get_nbits(p);
+  f->limbs = (f->bits + 63) / 64;
+  f->words = f->bits / 32;
+  f->montgomery = 0;
+  if (f->limbs > FE_LIMBS || ! gcry_mpi_test_bit(p, 0)) {
+    free(f);
+    return NULL;
+  }
+  limbs_from_mpi(f->p, FE_LIMBS, p);
+  for(i = 0; i < FE_LIMBS; i++)
+    f->one[i] = ! i;
+  f->reduce = NULL;
+
+  if (repr != FIELD_MONTGOMERY) {
+    h = gcry_mpi_new(0);
+    gcry_mpi_add_ui(h, p, 1);
+    mersenne = gcry_mpi_get_nbits(h) == f->bits + 1;
+    for(i = 0; mersenne && i < f->bits; i++)
+      mersenne = ! gcry_mpi_test_bit(h, i);
+    gcry_mpi_release(h);
+    if (mersenne)
+      f->reduce = reduce_mersenne;
+    for(i = 0; ! f->reduce && i < (int)NIST_PRIMES; i++)
+      if (is_prime(p, nist_primes[i].p)) {
+	f->reduce = nist_primes[i].reduce;
+	setup_delta(f, p);
+      }
+  }
+  if (! f->reduce && repr != FIELD_SPECIAL)
+    setup_montgomery(f, p);
+  if (! f->reduce) {
+    free(f);
+    return NULL;
+  }
+  return f;
+}
+
+void field_release(struct field *f)
+{
+  free(f);
+}
+
+/******************************************************************************/
+
+/* In Montgomery form x enters as x R = mont(x, R^2) and leaves as
+   mont(x R, 1)                                                               */
+void fe_from_mpi(fe_t r, const gcry_mpi_t x, const struct field *f)
+{
+  limbs_from_mpi(r, f->limbs, x);
+  if (f->montgomery)
+    fe_mul(r, r, f->r2, f);
+}
+
+void fe_to_mpi(gcry_mpi_t r, const fe_t a, const struct field *f)
+{
+  fe_t h, one;
+  int i;
+  if (f->montgomery) {
+    for(i = 0; i < FE_LIMBS; i++)
+      one[i] = ! i;
+    fe_mul(h, a, one, f);
+    a = h;
+  }
+  gcry_mpi_set_ui(r, 0);
+  for(i = 2 * f->limbs - 1; i >= 0; i--) {
+    gcry_mpi_mul_2exp(r, r, 32);
+    gcry_mpi_add_ui(r, r, (a[i / 2] >> (32 * (i & 1))) & 0xffffffff);
+  }
+}
+
+void fe_set(fe_t r, const fe_t a, const struct field *f)
+{
+  memcpy(r, a, f->limbs * sizeof(uint64_t));
+}
+
+void fe_load_zero(fe_t r, const struct field *f)
+{
+  memset(r, 0, f->limbs * sizeof(uint64_t));
+}
+
+int fe_is_zero(const fe_t a, const struct field *f)
+{
+  uint64_t acc = 0;
+  int i;
+  for(i = 0; i < f->limbs; i++)
+    acc |= a[i];
+  return ! acc;
+}
+
+int fe_equal(const fe_t a, const fe_t b, const struct field *f)
+{
+  return ! limbs_cmp(a, b, f->limbs);
+}
+
+void fe_add(fe_t r, const fe_t a, const fe_t b, const struct field *f)
+{
+  if (limbs_add(r, a, b, f->limbs) || limbs_cmp(r, f->p, f->limbs) >= 0)
+    limbs_sub(r, r, f->p, f->limbs);
+}
+
+void fe_sub(fe_t r, const fe_t a, const fe_t b, const struct field *f)
+{
+  if (limbs_sub(r, a, b, f->limbs))
+    limbs_add(r, r, f->p, f->limbs);
+}
+
+void fe_mul(fe_t r, const fe_t a, const fe_t b, const struct field *f)
+{
+  uint64_t t[2 * FE_LIMBS];
+  limbs_mul(t, a, b, f->limbs);
+  f->reduce(r, t, f);
+}
+
+void fe_sqr(fe_t r, const fe_t a, const struct field *f)
+{
+  uint64_t t[2 * FE_LIMBS];
+  limbs_sqr(t, a, f->limbs);
+  f->reduce(r, t, f);
+}
+
+/* a^(p - 2) with a fixed window of 4 bits                                    */
+void fe_inv(fe_t r, const fe_t a, const struct field *f)
+{
+  fe_t pow[16], e, two;
+  int i, j, d;
+  fe_set(pow[0], f->one, f);
+  for(i = 1; i < 16; i++)
+    fe_mul(pow[i], pow[i - 1], a, f);
+  memset(two, 0, sizeof(two));
+  two[0] = 2;
+  limbs_sub(e, f->p, two, f->limbs);
+  fe_set(r, f->one, f);
+  for(i = (f->bits + 3) / 4 - 1; i >= 0; i--) {
+    for(j = 0; j < 4; j++)
+      fe_sqr(r, r, f);
+    d = (e[i / 16] >> (4 * (i % 16))) & 15;
+    if (d)
+      fe_mul(r, r, pow[d], f);
+  }
+}
@@ -0,0 +1,90 @@
+/*
+ *  seccure  -  Copyright 2009 B. Poettering
+ *
+ *  Maintained by R. Tyler Ballance <tyler@slide.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* 
+ *   SECCURE Elliptic Curve Crypto Utility for Reliable Encryption
+ *
+ * Current homepage: http://slideinc.github.com/PyECC
+ * Original homepage: http://point-at-infinity.org/seccure/
+ *
+ *
+ * seccure implements a selection of asymmetric algorithms based on  
+ * elliptic curve cryptography (ECC). See the manpage or the project's  
+ * homepage for further details.
+ *
+ * This code links against the GNU gcrypt library "libgcrypt" (which
+ * is part of the GnuPG project). Use the included Makefile to build
+ * the binary.
+ * 
+ * Report bugs to: http://github.com/rtyler/PyECC/issues
+ */
+
+
+
+#ifndef INC_FIELD_H
+#define INC_FIELD_H
+
+#include <stdint.h>
+#include <gcrypt.h>
+
+/* Field elements are fixed arrays of little endian 64 bit limbs, large
+   enough for P-521. Elements are always kept fully reduced, in Montgomery
+   form if the field uses it; fe_from_mpi() and fe_to_mpi() convert.         */
+
+#define FE_LIMBS 9
+#define FE_WORDS 12         /* 32 bit words of P-384 */
+
+typedef uint64_t fe_t[FE_LIMBS];
+
+enum field_repr {
+  FIELD_ANY,
+  FIELD_SPECIAL,            /* fast reduction, Mersenne and NIST primes only */
+  FIELD_MONTGOMERY
+};
+
+struct field {
+  int bits, limbs;
+  fe_t p, one;
+  void (*reduce)(fe_t r, const uint64_t *t, const struct field *f);
+  /* The NIST primes are p = 2^(32 words) - delta                          */
+  int words;
+  int delta[FE_WORDS];
+  /* Montgomery form: pinv = -1/p mod 2^64, r2 = R^2 mod p                 */
+  int montgomery;
+  uint64_t pinv;
+  fe_t r2;
+};
+
+struct field* field_new(const gcry_mpi_t p, enum field_repr repr);
+void field_release(struct field *f);
+
+void fe_from_mpi(fe_t r, const gcry_mpi_t x, const struct field *f);
+void fe_to_mpi(gcry_mpi_t r, const fe_t a, const struct field *f);
+void fe_set(fe_t r, const fe_t a, const struct field *f);
+void fe_load_zero(fe_t r, const struct field *f);
+int fe_is_zero(const fe_t a, const struct field *f);
+int fe_equal(const fe_t a, const fe_t b, const struct field *f);
+void fe_add(fe_t r, const fe_t a, const fe_t b, const struct field *f);
+void fe_sub(fe_t r, const fe_t a, const fe_t b, const struct field *f);
+void fe_mul(fe_t r, const fe_t a, const fe_t b, const struct field *f);
+void fe_sqr(fe_t r, const fe_t a, const struct field *f);
+void fe_inv(fe_t r, const fe_t a, const struct field *f);
+
+#endif /* INC_FIELD_H */
@@ -20,6 +20,7 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -34,7 +35,27 @@
 #include "serialize.h"
 #include "aes256ctr.h"
 
+/*
+ * Older libgcrypt releases need to be told about the threading library
+ * before they are initialized; newer ones ignore this
+ */
+GCRY_THREAD_OPTION_PTHREAD_IMPL;
+
+/*
+ * __init_ecc_lock guards __init_ecc_refcount and the one-time libgcrypt
+ * setup, __keypair_lock guards publishing the public key cache of every 
+ * ::ECC_KeyPair
+ */
 static unsigned int __init_ecc_refcount = 0;
+static bool __gcrypt_initialized = false;
+static pthread_mutex_t __init_ecc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t __keypair_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The per-thread stream cache lives as long as some ::ECC_State does
+ */
+static void __stream_cache_create(void);
+static void __stream_cache_delete(void);
 
 /**
  * Print a warning to stderr
@@ -82,14 +103,25 @@ bool __init_ecc(ECC_State state)
 	if (state->gcrypt_init)
 		return true;
 
-	if (__init_ecc_refcount > 0) {
-		__init_ecc_refcount++;
+	pthread_mutex_lock(&__init_ecc_lock);
+
+	/*
+	 * libgcrypt is only set up once per process, even if every
+	 * ::ECC_State has been freed in the meantime
+	 */
+	if (__gcrypt_initialized) {
+		if (++__init_ecc_refcount == 1)
+			__stream_cache_create();
 		state->gcrypt_init = true;
+		pthread_mutex_unlock(&__init_ecc_lock);
 		return true;
 	}
 	
+	gcry_control(GCRYCTL_SET_THREAD_CBS, &gcry_threads_pthread);
+
 	if (!gcry_check_version(REQUIRED_LIBGCRYPT)) {
 		__gwarning("Incorrect libgcrypt version", err);
+		pthread_mutex_unlock(&__init_ecc_lock);
 		return false;
 	}
 
@@ -97,6 +129,16 @@ bool __init_ecc(ECC_State state)
 	if (gcry_err_code(err))
 		__gwarning("Cannot enable libgcrypt's secure memory management", err);
 
+#if GCRYPT_VERSION_NUMBER >= 0x010800
+	/*
+	 * Every thread working on an ::ECC_State holds its own secure buffers,
+	 * so let the pool grow past its initial size instead of failing
+	 */
+	err = gcry_control(GCRYCTL_AUTO_EXPAND_SECMEM, 32768);
+	if (gcry_err_code(err))
+		__gwarning("Cannot enable auto-expansion of the secure memory pool", err);
+#endif
+
 	if ( (state->options != NULL) && (state->options->secure_random) ) {
 		err = gcry_control(GCRYCTL_USE_SECURE_RNDPOOL, 1);
 		if (gcry_err_code(err))
@@ -109,17 +151,17 @@ bool __init_ecc(ECC_State state)
 	gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
 
 	state->gcrypt_init = true;
-	if (__init_ecc_refcount != 0) {
-		fprintf(stderr, "We've attempted to re-initialize the secure memory pool?\n");
-	}
-	__init_ecc_refcount = 2;
+	__gcrypt_initialized = true;
+	__init_ecc_refcount = 1;
+	__stream_cache_create();
 
+	pthread_mutex_unlock(&__init_ecc_lock);
 	return true;
 }
 
-struct curve_params *__curve_from_opts(ECC_Options opts)
+const struct curve_params *__curve_from_opts(ECC_Options opts)
 {
-	struct curve_params *c_params;
+	const struct curve_params *c_params;
 	/*
 	 * Pull out the curve if it's passed in on the opts object
 	 */
@@ -169,7 +211,10 @@ void ecc_free_state(ECC_State state)
 		curve_release(state->curveparams);
 	
 	if (state->gcrypt_init) {
-		__init_ecc_refcount--;
+		pthread_mutex_lock(&__init_ecc_lock);
+		if (--__init_ecc_refcount == 0)
+			__stream_cache_delete();
+		pthread_mutex_unlock(&__init_ecc_lock);
 	}
 
 	free(state);
@@ -183,6 +228,8 @@ void ecc_free_keypair(ECC_KeyPair kp)
 
 	if (kp->priv)
 		gcry_mpi_release(kp->priv);
+	if (kp->pub_table)
+		wnaf_table_release(kp->pub_table);
 
 	free(kp);
 	kp = NULL;
@@ -207,20 +254,27 @@ ECC_KeyPair ecc_new_keypair(char *pubkey, char *privkey, ECC_State state)
 	return ecc_new_keypair_s(pubkey, publen, privkey, privlen, state);
 }
 
-ECC_KeyPair ecc_new_keypair_s(char *pubkey, unsigned int pubkeylen, 
-		char *privkey, unsigned int privkeylen, ECC_State state)
+/*
+ * Shared by ecc_new_keypair_s() and ecc_new_keypair_bin(), `df` being the
+ * format of both keys
+ */
+static ECC_KeyPair __new_keypair(void *pubkey, unsigned int pubkeylen,
+		const char *privkey, unsigned int privkeylen, enum disp_format df)
 {
 	ECC_KeyPair kp = (ECC_KeyPair)(malloc(sizeof(struct _ECC_KeyPair)));
 
 	if (!kp) {
 		if (errno == ENOMEM)
-			__warning("Cannot allocate memory in ecc_new_keypair_s()");
+			__warning("Cannot allocate memory for a new ECC_KeyPair");
 		return NULL;
 	}
 
 	kp->pub = NULL;
 	kp->priv = NULL;
 	kp->pub_bytes = 0;
+	kp->pub_table = NULL;
+	kp->pub_curve = NULL;
+	kp->pub_bin = (df == DF_BIN);
 
 	if (pubkey != NULL) {
 		kp->pub = pubkey;
@@ -228,8 +282,8 @@ ECC_KeyPair ecc_new_keypair_s(char *pubkey, unsigned int pubkeylen,
 	}
 
 	if (privkey != NULL) {
-		if (!deserialize_mpi(&kp->priv, DF_COMPACT, privkey, privkeylen)) {
-			__warning("Failed to deserialize the private key in ecc_new_keypair_s()");
+		if (!deserialize_mpi(&kp->priv, df, privkey, privkeylen)) {
+			__warning("Failed to deserialize the private key");
 			ecc_free_keypair(kp);
 			return NULL;
 		}
@@ -238,6 +292,90 @@ ECC_KeyPair ecc_new_keypair_s(char *pubkey, unsigned int pubkeylen,
 	return kp;
 }
 
+ECC_KeyPair ecc_new_keypair_s(char *pubkey, unsigned int pubkeylen, 
+		char *privkey, unsigned int privkeylen, ECC_State state)
+{
+	return __new_keypair(pubkey, pubkeylen, privkey, privkeylen, DF_COMPACT);
+}
+
+ECC_KeyPair ecc_new_keypair_bin(void *pubkey, unsigned int pubkeylen,
+		const void *privkey, unsigned int privkeylen, ECC_State state)
+{
+	return __new_keypair(pubkey, pubkeylen, (const char *)(privkey), 
+			privkeylen, DF_BIN);
+}
+
+/*
+ * Decode the public key and precompute its multiples on first use, so that
+ * repeated calls against the same keypair skip the point decompression and
+ * table setup. The table also holds the public point itself.
+ *
+ * Once built the table is never modified until ecc_free_keypair(), so the
+ * pointer can be used outside of the lock. The table is built without 
+ * holding __keypair_lock, so first uses of different keypairs run in 
+ * parallel; threads racing on the same keypair each build one and all but
+ * the first to publish it release theirs. A keypair is bound to the curve
+ * it was first used with
+ */
+static const struct wnaf_table *__keypair_cached(ECC_KeyPair kp, 
+		const char *curve)
+{
+	if (!strcmp(kp->pub_curve, curve))
+		return kp->pub_table;
+	__warning("ECC_KeyPair was already used with a different curve");
+	return NULL;
+}
+
+static const struct wnaf_table *__keypair_table(ECC_KeyPair kp, ECC_State state)
+{
+	struct affine_point P;
+	struct wnaf_table *tab;
+	const struct wnaf_table *rc = NULL;
+	const char *curve = state->curveparams->name;
+	bool cached;
+
+	pthread_mutex_lock(&__keypair_lock);
+	if ( (cached = (kp->pub_table != NULL)) )
+		rc = __keypair_cached(kp, curve);
+	pthread_mutex_unlock(&__keypair_lock);
+	if (cached)
+		return rc;
+
+	if (kp->pub_bin) {
+		if ( (kp->pub_bytes != state->curveparams->pk_len_bin) || 
+				(!decompress_from_string(&P, kp->pub, DF_BIN, 
+					state->curveparams)) )
+			return NULL;
+	}
+	else if (!decompress_from_string(&P, kp->pub, DF_COMPACT, 
+				state->curveparams))
+		return NULL;
+
+	tab = wnaf_table_new(&P, &state->curveparams->dp);
+	point_release(&P);
+
+	if (!tab) {
+		if (errno == ENOMEM)
+			__warning("Cannot allocate memory for the public key table");
+		return NULL;
+	}
+
+	pthread_mutex_lock(&__keypair_lock);
+	if (kp->pub_table == NULL) {
+		kp->pub_table = tab;
+		kp->pub_curve = curve;
+		rc = tab;
+		tab = NULL;
+	}
+	else
+		rc = __keypair_cached(kp, curve);
+	pthread_mutex_unlock(&__keypair_lock);
+
+	if (tab)
+		wnaf_table_release(tab);
+	return rc;
+}
+
 ECC_Data ecc_new_data()
 {
 	ECC_Data data = (ECC_Data)(malloc(sizeof(struct _ECC_Data)));
@@ -250,6 +388,7 @@ ECC_Data ecc_new_data()
 
 	data->data = NULL;
 	data->datalen = 0;
+	data->legacy_mac = false;
 	return data;
 }
 void ecc_free_data(ECC_Data data)
@@ -276,25 +415,21 @@ ECC_Options ecc_new_options()
 	 */
 	opts->secure_random = true;
 	opts->curve = DEFAULT_CURVE;
+	opts->payload = ECC_PAYLOAD_CTR_HMAC;
+	opts->legacy_mac = false;
 
 	return opts;
 }
 
-ECC_KeyPair ecc_keygen(void *priv, ECC_State state)
+/*
+ * Draw a random private exponent: random bytes from libgcrypt's strong
+ * generator fed through hash_to_exponent()
+ */
+static gcry_mpi_t __random_exponent(ECC_State state)
 {
-	ECC_KeyPair result = NULL;
-	struct affine_point ap;
-	char *r;
-	unsigned int bits;
-
-	if (priv != NULL)
-		return NULL;
-
-	/* 
-	 * Generate our own private key via /dev/urandom
-	 */
-	bits = gcry_mpi_get_nbits(state->curveparams->dp.order);
-	r = (char *)(malloc(bits));
+	unsigned int bits = gcry_mpi_get_nbits(state->curveparams->dp.order);
+	char *r = (char *)(malloc(bits));
+	gcry_mpi_t exp;
 
 	if (!r) {
 		if (errno == ENOMEM) 
@@ -303,9 +438,25 @@ ECC_KeyPair ecc_keygen(void *priv, ECC_State state)
 	}
 
 	gcry_randomize(r, bits, GCRY_VERY_STRONG_RANDOM);
+	exp = hash_to_exponent(r, state->curveparams);
+	free(r);
+	return exp;
+}
+
+/*
+ * Wrap a private exponent and its public point into a new keypair, which
+ * takes over `priv` on success
+ */
+static ECC_KeyPair __keypair_from_point(gcry_mpi_t priv, 
+		const struct affine_point *ap, ECC_State state)
+{
+	ECC_KeyPair result = NULL;
+	unsigned int len = state->curveparams->pk_len_compact;
+	char *r = (char *)(malloc(sizeof(char) * (len + 1)));
 
 	if (!r) {
-		__warning("Failed to generate a random buffer of N bytes");
+		if (errno == ENOMEM)
+			__warning("Cannot allocate `r` again in ecc_keygen()");
 		return NULL;
 	}
 
@@ -313,394 +464,1287 @@ ECC_KeyPair ecc_keygen(void *priv, ECC_State state)
 
 	if (!result) {
 		__warning("Failed to generate empty keypair in ecc_keygen()!");
-		if (r)
-			free(r);
+		free(r);
 		return NULL;
 	}
 
-	result->priv = hash_to_exponent(r, state->curveparams);
+	compress_to_string((char *)(r), DF_COMPACT, ap, state->curveparams);
+	r[len] = '\0';
 
-	if (r) {
-		free(r);
-		r = NULL;
-	}
+	result->priv = priv;
+	result->pub = r;
+	result->pub_bytes = len + 1;
+	return result;
+}
+
+ECC_KeyPair ecc_keygen(void *priv, ECC_State state)
+{
+	ECC_KeyPair result = NULL;
+	struct affine_point ap;
+	gcry_mpi_t exp;
 
-	r = (char *)(malloc(sizeof(char) * (state->curveparams->pk_len_compact + 1)));
+	if (priv != NULL)
+		return NULL;
 
-	if (!r) {
-		if (errno == ENOMEM)
-			__warning("Cannot allocate `r` again in ecc_keygen()");
+	if (!(exp = __random_exponent(state)))
 		return NULL;
-	}
 
-	ap = pointmul(&state->curveparams->dp.base, result->priv,
+	ap = pointmul(&state->curveparams->dp.base, exp,
 		&state->curveparams->dp);
-
-	compress_to_string((char *)(r), DF_COMPACT, &ap, state->curveparams);
-
+	result = __keypair_from_point(exp, &ap, state);
 	point_release(&ap);
 
-	result->pub = r;
-	r[state->curveparams->pk_len_compact] = '\0';
-	result->pub_bytes = (unsigned int)(state->curveparams->pk_len_compact + 1);
-
+	if (!result)
+		gcry_mpi_release(exp);
 	return result;
 }
 
-const char *ecc_mpi_to_str(gcry_mpi_t key)
+/*
+ * Keys are generated in chunks of KEYGEN_BATCH, the public points of a
+ * chunk sharing one field inversion
+ */
+#define KEYGEN_BATCH 64
+
+/*
+ * Fill keys[0..n) with fresh keypairs, KEYGEN_BATCH at a time.  Entries
+ * already written are left in place on failure for the caller to free
+ */
+static bool __keygen_fill(ECC_KeyPair *keys, unsigned int n, ECC_State state)
 {
-	gcry_error_t err = 0;
-	unsigned char *buf;
-	size_t written;
+	gcry_mpi_t exp[KEYGEN_BATCH];
+	struct affine_point ap[KEYGEN_BATCH];
+	unsigned int i, j, count;
+	bool failed = false;
+
+	for (i = 0; i < n && !failed; i += count) {
+		count = n - i < KEYGEN_BATCH ? n - i : KEYGEN_BATCH;
+
+		for (j = 0; j < count; ++j) {
+			if (!(exp[j] = __random_exponent(state))) {
+				while (j--)
+					gcry_mpi_release(exp[j]);
+				return false;
+			}
+		}
 
-	if (!key)
-		return NULL;
+		pointmul_base_batch(ap, exp, count, &state->curveparams->dp);
 
-	err = gcry_mpi_aprint(GCRYMPI_FMT_HEX, &buf, &written, key);
-	if (err) {
-		__gwarning("Failed to call gcry_mpi_aprint() in ecc_key_to_str()", err);
-		return NULL;
+		for (j = 0; j < count; ++j) {
+			keys[i + j] = __keypair_from_point(exp[j], &ap[j], state);
+			if (!keys[i + j]) {
+				gcry_mpi_release(exp[j]);
+				failed = true;
+			}
+			point_release(&ap[j]);
+		}
 	}
-	return (const char *)(buf);
+	return !failed;
 }
 
-ECC_Data ecc_decrypt(ECC_Data encrypted, ECC_KeyPair keypair, ECC_State state)
+static ECC_KeyPair *__keygen_alloc(unsigned int n, ECC_State state)
 {
-	ECC_Data rc = NULL;
-	int offset;
-	char *keybuf, *block;
-	struct aes256ctr *ac;
-	gcry_md_hd_t digest;
-	struct affine_point *R = NULL;
+	ECC_KeyPair *keys = NULL;
 
-	if (!__verify_state(state)) {
-		__warning("Invalid state passed to ecc_decrypt()");
-		goto exit;
-	}
-	if (!__verify_keypair(keypair, true, false)) {
-		__warning("Invalid keypair passed to ecc_decrypt()");
-		goto exit;
+	if (!state) {
+		__warning("Invalid or uninitialized ECC_State object");
+		return NULL;
 	}
 
-	/*
-	 * Take the first bits off buffer to get the curve info
-	 */
-	R = (struct affine_point *)(malloc(sizeof(struct affine_point)));
+	keys = (ECC_KeyPair *)(calloc(n ? n : 1, sizeof(ECC_KeyPair)));
 
-	if (!R) {
-		if (errno == ENOMEM) 
-			__warning("Cannot allocate memory for `R` in ecc_decrypt()");
+	if (!keys) {
+		if (errno == ENOMEM)
+			__warning("Cannot allocate the keypair array");
 		return NULL;
 	}
+	return keys;
+}
 
-	if (!decompress_from_string(R, (char *)(encrypted->data), DF_BIN, 
-				state->curveparams)) {
-		__warning("Failed to decompress_from_string() in ecc_decrypt()");
-		goto exit;
-	}
+ECC_KeyPair *ecc_keygen_batch(unsigned int n, ECC_State state)
+{
+	ECC_KeyPair *keys = __keygen_alloc(n, state);
 
-	/* Why only 64? */
-	if (!(keybuf = gcry_malloc_secure(64))) { 
-		__warning("Out of secure memory!");
-		goto bailout;
-	}
+	if (!keys)
+		return NULL;
 
-	if (!ECIES_decryption(keybuf, R, keypair->priv, state->curveparams)) {
-		__warning("ECIES_decryption() failed");
-		goto bailout;
+	if (!__keygen_fill(keys, n, state)) {
+		ecc_free_keypairs(keys, n);
+		return NULL;
 	}
+	return keys;
+}
 
-	if (!(ac = aes256ctr_init(keybuf))) {
-		__warning("Cannot initialize AES256-CTR");
-		goto bailout;
-	}
+/*
+ * One slice of the output array handed to a worker thread of
+ * ecc_keygen_many()
+ */
+struct __keygen_slice {
+	ECC_KeyPair *keys;
+	unsigned int n;
+	ECC_State state;
+	bool ok;
+};
+
+static void *__keygen_worker(void *arg)
+{
+	struct __keygen_slice *slice = (struct __keygen_slice *)(arg);
+	slice->ok = __keygen_fill(slice->keys, slice->n, slice->state);
+	return NULL;
+}
 
-	if (!(hmacsha256_init(&digest, keybuf + 32, HMAC_KEY_SIZE))) {
-		__warning("Couldn't initialize HMAC-SHA256");
-		goto bailout;
-	}
+ECC_KeyPair *ecc_keygen_many(unsigned int n, ECC_State state, 
+		unsigned int threads)
+{
+	ECC_KeyPair *keys = __keygen_alloc(n, state);
+	struct __keygen_slice *slices = NULL;
+	pthread_t *tids = NULL;
+	unsigned int i, offset, started = 0;
+	bool ok = true;
 
-	rc = ecc_new_data();
-	bzero(keybuf, 64);
+	if (!keys)
+		return NULL;
 
 	/*
-	 * Decrypt the rest of the block (the actual encrypted data)
+	 * Every worker gets at least a full batch, otherwise the shared
+	 * inversion buys little and thread startup dominates; fewer keys
+	 * than two batches are generated on the calling thread
 	 */
-	block = ((char *)(encrypted->data) + state->curveparams->pk_len_bin);
-	offset = (encrypted->datalen - state->curveparams->pk_len_bin);
+	if (threads > n / KEYGEN_BATCH)
+		threads = n / KEYGEN_BATCH;
 
-	gcry_md_write(digest, block, offset);
-
-	aes256ctr_dec(ac, block, offset);
+	if (threads <= 1) {
+		ok = __keygen_fill(keys, n, state);
+		goto done;
+	}
 
-	/* aes256ctr_done() will also handle gcry_free()'ing the pointer */
-	aes256ctr_done(ac);
-	/* gcry_md_close() will also handle gcry_free()'ing the pointer */
-	gcry_md_close(digest);
+	slices = (struct __keygen_slice *)(calloc(threads, 
+			sizeof(struct __keygen_slice)));
+	tids = (pthread_t *)(calloc(threads, sizeof(pthread_t)));
 
-	offset = offset - DEFAULT_MAC_LEN;
-	rc->data = (void *)(malloc(sizeof(char) * (offset + 1)));
-	if (!rc->data) {
+	if (!slices || !tids) {
 		if (errno == ENOMEM)
-			__warning("Cannot allocate memory for `rc->data` in ecc_decrypt()");
-		goto bailout;
+			__warning("Cannot allocate memory in ecc_keygen_many()");
+		ok = false;
+		goto done;
 	}
-	rc->datalen = offset;
-	memcpy(rc->data, block, offset);
-
-	((char *)rc->data)[offset] = '\0';
-
-	bailout:
-		point_release(R);
-		free(R);
-		gcry_free(keybuf);
-		keybuf = NULL;
-	exit:
-		return rc;
-}
-
-ECC_Data ecc_encrypt(void *data, int databytes, ECC_KeyPair keypair, ECC_State state)
-{
-	ECC_Data rc = NULL;
-	struct affine_point *P, *R;
-	struct aes256ctr *ac;
-	char *readbuf;
-	char *keybuf = NULL;
-	char *md;
-	void *plaintext = NULL;
-	unsigned int offset = 0;
-	gcry_md_hd_t digest;
 
-	if ( (data == NULL) ) {
-		__warning("Invalid or empty `data` argument passed to ecc_verify()");
-		goto exit;
+	/*
+	 * The fixed-base comb table is shared by all workers; build it
+	 * up front instead of having them queue on its lock
+	 */
+	if (state->curveparams->dp.comb)
+		comb_precompute(state->curveparams->dp.comb, 
+				&state->curveparams->dp);
+
+	for (i = 0, offset = 0; i < threads; ++i) {
+		slices[i].keys = keys + offset;
+		slices[i].n = n / threads + (i < n % threads ? 1 : 0);
+		slices[i].state = state;
+		offset += slices[i].n;
 	}
-	if (!__verify_keypair(keypair, false, true)) {
-		__warning("Invalid ECC_KeyPair object passed to ecc_verify()");
-		goto exit;
+
+	for (started = 0; started < threads; ++started) {
+		if (pthread_create(&tids[started], NULL, __keygen_worker, 
+					&slices[started]) != 0) {
+			__warning("Failed to start a worker in ecc_keygen_many()");
+			ok = false;
+			break;
+		}
 	}
-	if (!__verify_state(state)) {
-		__warning("Invalid or uninitialized ECC_State object");
-		goto exit;
+
+	for (i = 0; i < started; ++i) {
+		pthread_join(tids[i], NULL);
+		ok = ok && slices[i].ok;
 	}
 
-	readbuf = (char *)(malloc(sizeof(char) * state->curveparams->pk_len_bin));
-	P = (struct affine_point *)(malloc(sizeof(struct affine_point)));
-	R = (struct affine_point *)(malloc(sizeof(struct affine_point)));
+done:
+	free(slices);
+	free(tids);
 
-	if ( (!readbuf) || (!R) || (!P) ) {
-		if (errno == ENOMEM)
-			__warning("Cannot allocate memory for `readbuf`, `P`, `R` in ecc_encrypt()");
-		if (R)
-			free(R);
-		if (P)
-			free(P);
-		if (readbuf)
-			free(readbuf);
+	if (!ok) {
+		ecc_free_keypairs(keys, n);
 		return NULL;
 	}
+	return keys;
+}
 
-	if (!decompress_from_string(P, (char *)keypair->pub, 
-			DF_COMPACT, state->curveparams)) {
-		__warning("Invalid public key");
-		goto exit;
-	}
+void ecc_free_keypairs(ECC_KeyPair *keys, unsigned int n)
+{
+	unsigned int i;
 
-	/* Why only 64? */
-	if (!(keybuf = gcry_malloc_secure(64))) { 
-		__warning("Out of secure memory!");
-		goto exit;
-	}
-	*R = ECIES_encryption(keybuf, P, state->curveparams);
-	compress_to_string(readbuf, DF_BIN, R, state->curveparams);
+	if (keys == NULL)
+		return;
 
-	if (!(ac = aes256ctr_init(keybuf))) {
-		__warning("Cannot initialize AES256-CTR");
-		goto release;
-	}
-	if (!(hmacsha256_init(&digest, keybuf + 32, HMAC_KEY_SIZE))) {
-		__warning("Couldn't initialize HMAC-SHA256");
-		goto release;
+	for (i = 0; i < n; ++i) {
+		if (keys[i] == NULL)
+			continue;
+		free(keys[i]->pub);
+		ecc_free_keypair(keys[i]);
 	}
+	free(keys);
+}
 
-	rc = ecc_new_data();
-	/*
-	 * The data buffer should be in three sections:
-	 *    - rbuffer
-	 *    - cipher
-	 *    - hmac
-	 */
-	rc->data = (void *)(malloc( 
-			(sizeof(char) * state->curveparams->pk_len_bin) + 
-			(sizeof(char) * databytes) +
-			(sizeof(char) * DEFAULT_MAC_LEN)));
-
-	if (!rc->data) {
-		if (errno == ENOMEM) 
-			__warning("Cannot allocate memory for `rc->data` in ecc_encrypt()");
-		ecc_free_data(rc);
-		goto release;
-	}
+const char *ecc_mpi_to_str(gcry_mpi_t key)
+{
+	gcry_error_t err = 0;
+	unsigned char *buf;
+	size_t written;
 
-	plaintext = (void *)(malloc(sizeof(char) * databytes));
+	if (!key)
+		return NULL;
 
-	if (!plaintext) {
-		if (errno == ENOMEM)
-			__warning("Cannot allocate memory for `plaintext` in ecc_encrypt()");
-		ecc_free_data(rc);
-		goto release;
+	err = gcry_mpi_aprint(GCRYMPI_FMT_HEX, &buf, &written, key);
+	if (err) {
+		__gwarning("Failed to call gcry_mpi_aprint() in ecc_key_to_str()", err);
+		return NULL;
 	}
-	memcpy(plaintext, data, databytes);
-
-	aes256ctr_enc(ac, plaintext, databytes);
-	aes256ctr_done(ac);
-
-	gcry_md_final(digest);
-	md = (char *)(gcry_md_read(digest, 0));
+	return (const char *)(buf);
+}
 
-	/* 
-	 * Overlay the three segments for the data buffer via memcpy(3)
-	 */
-	memcpy(rc->data, readbuf, state->curveparams->pk_len_bin);
-	offset = state->curveparams->pk_len_bin;
-	
-	memcpy((char *)(rc->data) + offset, plaintext, databytes);
-	offset += databytes;
+/*
+ * ::ECC_Stream carries the cipher and MAC state of an incremental
+ * encryption or decryption between calls. GCM streams (`aead` set) only 
+ * use `gcm`, CTR+HMAC streams only `ac` and `digest`; the other handles 
+ * may still be open from an earlier message
+ */
+struct _ECC_Stream {
+	struct aes256ctr *ac;
+	gcry_md_hd_t digest;
+	gcry_cipher_hd_t gcm;
+	bool aead;
+	char tail[GCM_TAG_SIZE];
+	unsigned int taillen;
+	unsigned int maclen;
+};
 
-	memcpy((char *)(rc->data) + offset, md, DEFAULT_MAC_LEN);
-	offset += DEFAULT_MAC_LEN;
+/*
+ * Opening the cipher and MAC handles costs more than encrypting a typical
+ * payload, so every thread keeps the last stream it released in its
+ * __stream_cache slot and re-keys its handles for the next message. The 
+ * handles live in secure memory like the keys themselves, and a parked
+ * stream is re-keyed with zeros so it doesn't keep the last message's keys
+ *
+ * The key is created with the first ::ECC_State and deleted with the last
+ * one, which closes the streams parked in every slot on __stream_slots;
+ * __stream_cache_lock guards that list
+ */
+struct __stream_slot {
+	ECC_Stream stream;
+	struct __stream_slot *prev, *next;
+};
+static pthread_key_t __stream_cache;
+static bool __stream_cache_ok = false;
+static struct __stream_slot *__stream_slots = NULL;
+static pthread_mutex_t __stream_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void __close_stream(ECC_Stream stream)
+{
+	if (stream->gcm)
+		gcry_cipher_close(stream->gcm);
+	if (stream->ac)
+		aes256ctr_done(stream->ac);
+	if (stream->digest)
+		gcry_md_close(stream->digest);
+	memset(stream->tail, 0, GCM_TAG_SIZE);
+	free(stream);
+}
 
-	rc->datalen = offset;
+static void __stream_slot_free(struct __stream_slot *slot)
+{
+	if (slot->stream)
+		__close_stream(slot->stream);
+	free(slot);
+}
 
-	free(plaintext);
-	/*
-	 * Upon closing the hash digest, the `md` pointer should also
-	 * be freed
-	 */
-	gcry_md_close(digest);
+/*
+ * Runs when a thread exits; the slot may already have been released by
+ * __stream_cache_delete() while this thread waited for the lock
+ */
+static void __stream_slot_release(void *arg)
+{
+	struct __stream_slot *slot = (struct __stream_slot *)(arg), *s;
+
+	pthread_mutex_lock(&__stream_cache_lock);
+	for (s = __stream_slots; (s != NULL) && (s != slot); s = s->next)
+		;
+	if (s) {
+		if (slot->prev)
+			slot->prev->next = slot->next;
+		else
+			__stream_slots = slot->next;
+		if (slot->next)
+			slot->next->prev = slot->prev;
+		__stream_slot_free(slot);
+	}
+	pthread_mutex_unlock(&__stream_cache_lock);
+}
 
-	release:
-		gcry_free(keybuf);
-		point_release(P);
-		point_release(R);
-		free(P);
-		free(R);
-		free(readbuf);
-	exit:
-		return rc;
+/*
+ * Called with __init_ecc_lock held
+ */
+static void __stream_cache_create(void)
+{
+	__stream_cache_ok = !pthread_key_create(&__stream_cache, 
+			__stream_slot_release);
 }
 
-ECC_Data ecc_sign(char *data, ECC_KeyPair keypair, ECC_State state)
+static void __stream_cache_delete(void)
 {
-	ECC_Data rc = NULL;
-	gcry_md_hd_t digest;
-	gcry_error_t err = 0;
-	gcry_mpi_t signature = NULL;
-	char *digest_buf, *serialized;
+	struct __stream_slot *slot;
 
-	/* 
-	 * Preliminary argument checks, just for sanity of the library 
+	if (!__stream_cache_ok)
+		return;
+
+	pthread_mutex_lock(&__stream_cache_lock);
+	pthread_key_delete(__stream_cache);
+	__stream_cache_ok = false;
+	while ( (slot = __stream_slots) ) {
+		__stream_slots = slot->next;
+		__stream_slot_free(slot);
+	}
+	pthread_mutex_unlock(&__stream_cache_lock);
+}
+
+/*
+ * This thread's slot of __stream_cache, registered on first use
+ */
+static struct __stream_slot *__stream_slot(void)
+{
+	struct __stream_slot *slot;
+
+	if (!__stream_cache_ok)
+		return NULL;
+	if ( (slot = (struct __stream_slot *)(pthread_getspecific(__stream_cache))) )
+		return slot;
+
+	if (!(slot = (struct __stream_slot *)(calloc(1, sizeof(struct __stream_slot)))))
+		return NULL;
+	if (pthread_setspecific(__stream_cache, slot) != 0) {
+		free(slot);
+		return NULL;
+	}
+	pthread_mutex_lock(&__stream_cache_lock);
+	slot->next = __stream_slots;
+	if (__stream_slots)
+		__stream_slots->prev = slot;
+	__stream_slots = slot;
+	pthread_mutex_unlock(&__stream_cache_lock);
+	return slot;
+}
+
+/*
+ * Re-key every handle of a stream that is about to be parked with zeros
+ */
+static bool __scrub_stream(ECC_Stream stream)
+{
+	static const char zero[CIPHER_KEY_SIZE];
+	bool ok = true;
+
+	if (stream->gcm)
+		ok = aes256gcm_rekey(stream->gcm, zero, zero) && ok;
+	if (stream->ac)
+		ok = aes256ctr_rekey(stream->ac, zero) && ok;
+	if (stream->digest)
+		ok = hmacsha256_rekey(stream->digest, zero, HMAC_KEY_SIZE) && ok;
+	return ok;
+}
+
+static enum ecc_payload __payload(ECC_State state)
+{
+	if (state->options == NULL)
+		return ECC_PAYLOAD_CTR_HMAC;
+	return state->options->payload;
+}
+
+/*
+ * Derive the AES-256-CTR and HMAC-SHA256 keys, or the AES-256-GCM key and
+ * nonce, from the 64 bytes of ECIES key material and set up a new stream
+ * with them
+ */
+static ECC_Stream __new_stream(char *keybuf, bool aead)
+{
+	struct __stream_slot *slot = __stream_slot();
+	ECC_Stream stream = NULL;
+	bool ok;
+
+	if (slot) {
+		stream = slot->stream;
+		slot->stream = NULL;
+	}
+	if (!stream) {
+		stream = (ECC_Stream)(calloc(1, sizeof(struct _ECC_Stream)));
+		if (!stream) {
+			if (errno == ENOMEM)
+				__warning("Cannot allocate memory for an ECC_Stream");
+			return NULL;
+		}
+	}
+	stream->taillen = 0;
+	stream->aead = aead;
+
+	if (aead) {
+		stream->maclen = GCM_TAG_SIZE;
+		if (stream->gcm)
+			ok = aes256gcm_rekey(stream->gcm, keybuf, keybuf + 32);
+		else if (!(ok = aes256gcm_init(&stream->gcm, keybuf, keybuf + 32)))
+			stream->gcm = NULL;
+		if (!ok) {
+			__warning("Cannot initialize AES256-GCM");
+			__close_stream(stream);
+			return NULL;
+		}
+		return stream;
+	}
+
+	stream->maclen = DEFAULT_MAC_LEN;
+	if (stream->ac)
+		ok = aes256ctr_rekey(stream->ac, keybuf);
+	else
+		ok = (stream->ac = aes256ctr_init(keybuf)) != NULL;
+	if (!ok) {
+		__warning("Cannot initialize AES256-CTR");
+		__close_stream(stream);
+		return NULL;
+	}
+	if (stream->digest)
+		ok = hmacsha256_rekey(stream->digest, keybuf + 32, HMAC_KEY_SIZE);
+	else
+		ok = hmacsha256_init(&stream->digest, keybuf + 32, HMAC_KEY_SIZE);
+	if (!ok) {
+		__warning("Couldn't initialize HMAC-SHA256");
+		__close_stream(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+/*
+ * Payloads are encrypted and MACed STREAM_CHUNK bytes at a time, so that
+ * the second pass over each chunk finds it still in the L1 cache
+ */
+#define STREAM_CHUNK 8192
+
+/*
+ * Move `len` bytes from `in` to `out`, which may overlap, and run them 
+ * through the stream's cipher and MAC in a single pass: encrypt-then-MAC
+ * when encrypting, MAC-then-decrypt when decrypting
+ */
+static void __stream_crypt(ECC_Stream stream, const char *in, char *out,
+		unsigned int len, bool encrypt)
+{
+	const char *src;
+	unsigned int n;
+	bool copy;
+
+	/*
+	 * Copying chunk by chunk would overwrite input that hasn't been 
+	 * read yet if `out` lies inside it
 	 */
-	if (!data) {
-		__warning("Invalid or empty `data` argument passed to ecc_sign()");
-		goto exit;
+	if ( (out > in) && (out < in + len) ) {
+		memmove(out, in, len);
+		in = out;
 	}
-	if (!__verify_keypair(keypair, true, false)) {
-		__warning("Invalid ECC_KeyPair object passed to ecc_sign()");
-		goto exit;
+
+	/*
+	 * Disjoint buffers are encrypted straight from `in` to `out`, only
+	 * overlapping ones are moved first
+	 */
+	copy = (in != out) && ( (out + len <= in) || (in + len <= out) );
+
+	for (; len > 0; in += n, out += n, len -= n) {
+		n = len < STREAM_CHUNK ? len : STREAM_CHUNK;
+		src = in;
+		if ( (in != out) && (!copy) ) {
+			memmove(out, in, n);
+			src = out;
+		}
+		if (stream->aead) {
+			if (encrypt)
+				gcry_cipher_encrypt(stream->gcm, out, n, src, n);
+			else
+				gcry_cipher_decrypt(stream->gcm, out, n, src, n);
+		}
+		else if (encrypt) {
+			aes256ctr_enc_copy(stream->ac, out, src, n);
+			gcry_md_write(stream->digest, out, n);
+		}
+		else {
+			gcry_md_write(stream->digest, src, n);
+			aes256ctr_dec_copy(stream->ac, out, src, n);
+		}
+	}
+}
+
+/*
+ * Compare a MAC without an early exit, so the time taken doesn't depend
+ * on where the first difference is
+ */
+static bool __mac_equal(const unsigned char *md, const char *mac)
+{
+	unsigned char diff = 0;
+	unsigned int i;
+
+	for (i = 0; i < DEFAULT_MAC_LEN; ++i)
+		diff |= md[i] ^ (unsigned char)(mac[i]);
+	return diff == 0;
+}
+
+/*
+ * Finish the stream's MAC and compare it with `mac`; libgcrypt checks GCM
+ * tags in constant time itself
+ */
+static bool __stream_check(ECC_Stream stream, const char *mac)
+{
+	if (stream->aead)
+		return !gcry_err_code(gcry_cipher_checktag(stream->gcm, mac, 
+					GCM_TAG_SIZE));
+
+	gcry_md_final(stream->digest);
+	return __mac_equal(gcry_md_read(stream->digest, 0), mac);
+}
+
+/*
+ * Park the stream in this thread's __stream_cache slot if that is empty,
+ * otherwise close it for good
+ */
+void ecc_free_stream(ECC_Stream stream)
+{
+	struct __stream_slot *slot;
+
+	if (stream == NULL)
+		return;
+
+	memset(stream->tail, 0, GCM_TAG_SIZE);
+	stream->taillen = 0;
+	if ( ((slot = __stream_slot()) != NULL) && (slot->stream == NULL) &&
+			(__scrub_stream(stream)) ) {
+		slot->stream = stream;
+		return;
+	}
+	__close_stream(stream);
+}
+
+ECC_Stream ecc_encrypt_init(char *header, ECC_KeyPair keypair, ECC_State state)
+{
+	ECC_Stream stream = NULL;
+	const struct wnaf_table *tab;
+	struct affine_point R;
+	char *keybuf;
+
+	if (header == NULL) {
+		__warning("Invalid `header` argument passed to ecc_encrypt_init()");
+		return NULL;
+	}
+	if (!__verify_keypair(keypair, false, true)) {
+		__warning("Invalid ECC_KeyPair object passed to ecc_encrypt_init()");
+		return NULL;
 	}
 	if (!__verify_state(state)) {
 		__warning("Invalid or uninitialized ECC_State object");
-		goto exit;
+		return NULL;
+	}
+	if (!(tab = __keypair_table(keypair, state))) {
+		__warning("Invalid public key");
+		return NULL;
+	}
+	if (!(keybuf = gcry_malloc_secure(64))) {
+		__warning("Out of secure memory!");
+		return NULL;
+	}
+
+	R = ECIES_encryption_precomp(keybuf, tab, state->curveparams);
+	compress_to_string(header, DF_BIN, &R, state->curveparams);
+	point_release(&R);
+
+	if (__payload(state) == ECC_PAYLOAD_GCM)
+		header[0] |= ECIES_AEAD_FLAG;
+	stream = __new_stream(keybuf, __payload(state) == ECC_PAYLOAD_GCM);
+
+	memset(keybuf, 0, 64);
+	gcry_free(keybuf);
+	return stream;
+}
+
+bool ecc_encrypt_update(ECC_Stream stream, const void *in, void *out, 
+		unsigned int len)
+{
+	if ( (stream == NULL) || (in == NULL) || (out == NULL) )
+		return false;
+
+	__stream_crypt(stream, (const char *)(in), (char *)(out), len, true);
+	return true;
+}
+
+bool ecc_encrypt_final(ECC_Stream stream, char *mac)
+{
+	if (stream == NULL)
+		return false;
+	if (mac == NULL) {
+		ecc_free_stream(stream);
+		return false;
+	}
+
+	if (stream->aead)
+		gcry_cipher_gettag(stream->gcm, mac, GCM_TAG_SIZE);
+	else {
+		gcry_md_final(stream->digest);
+		memcpy(mac, gcry_md_read(stream->digest, 0), DEFAULT_MAC_LEN);
+	}
+	ecc_free_stream(stream);
+	return true;
+}
+
+ECC_Stream ecc_decrypt_init(const char *header, ECC_KeyPair keypair, 
+		ECC_State state)
+{
+	ECC_Stream stream = NULL;
+	struct affine_point R;
+	char *keybuf;
+	bool aead;
+
+	if (header == NULL) {
+		__warning("Invalid `header` argument passed to ecc_decrypt_init()");
+		return NULL;
+	}
+	if (!__verify_keypair(keypair, true, false)) {
+		__warning("Invalid keypair passed to ecc_decrypt_init()");
+		return NULL;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid state passed to ecc_decrypt_init()");
+		return NULL;
 	}
 
 	/*
-	 * Open up message digest for the signing
+	 * The payload scheme is flagged in the top bit of the header, which
+	 * has to be cleared again before the point can be decompressed
 	 */
-	err = gcry_md_open(&digest, GCRY_MD_SHA512, 0);
-	if (gcry_err_code(err)) {
-		__gwarning("Failed to initialize SHA-512 message digest", err);
+	char point[state->curveparams->pk_len_bin];
+	memcpy(point, header, state->curveparams->pk_len_bin);
+	aead = (point[0] & ECIES_AEAD_FLAG) != 0;
+	point[0] &= ~ECIES_AEAD_FLAG;
+
+	if (!decompress_from_string(&R, point, DF_BIN, state->curveparams)) {
+		__warning("Failed to decompress_from_string() in ecc_decrypt_init()");
+		return NULL;
+	}
+	if (!(keybuf = gcry_malloc_secure(64))) {
+		__warning("Out of secure memory!");
 		goto bailout;
 	}
 
+	if (ECIES_decryption(keybuf, &R, keypair->priv, state->curveparams))
+		stream = __new_stream(keybuf, aead);
+	else
+		__warning("ECIES_decryption() failed");
+
+	memset(keybuf, 0, 64);
+	gcry_free(keybuf);
+
+	bailout:
+		point_release(&R);
+		return stream;
+}
+
+int ecc_decrypt_update(ECC_Stream stream, const void *in, void *out, 
+		unsigned int len)
+{
+	char tail[GCM_TAG_SIZE];
+	unsigned int t, total, written, m;
+
+	if ( (stream == NULL) || (in == NULL) || (out == NULL) )
+		return -1;
+
 	/*
-	 * Write our data into the message digest buffer for gcrypt
+	 * The last `maclen` bytes seen so far may be the MAC, so they are 
+	 * held back in `tail` until more data (or ecc_decrypt_final()) 
+	 * arrives; everything before them is ciphertext
 	 */
-	gcry_md_write(digest, data, strlen(data));
-	gcry_md_final(digest);
-	digest_buf = (char *)(gcry_md_read(digest, 0));
+	m = stream->maclen;
+	t = stream->taillen;
+	total = t + len;
+	if (total <= m) {
+		memcpy(stream->tail + t, in, len);
+		stream->taillen = total;
+		return 0;
+	}
+	written = total - m;
 
-	if (digest_buf == NULL) {
-		__warning("Digest buffer was NULL");
-		goto bailout;
+	if (len >= m) {
+		memcpy(tail, (const char *)(in) + len - m, m);
+	}
+	else {
+		memcpy(tail, stream->tail + t - (m - len), m - len);
+		memcpy(tail + m - len, in, len);
 	}
 
-	signature = ECDSA_sign(digest_buf, keypair->priv, state->curveparams);
+	/* `in` and `out` may be the same buffer, so move it before the tail */
+	if (written > t) {
+		memmove((char *)(out) + t, in, written - t);
+		memcpy(out, stream->tail, t);
+	}
+	else
+		memcpy(out, stream->tail, written);
 
-	if (signature == NULL) {
-		__warning("ECDSA_sign() returned a NULL signature");
-		goto bailout;
+	memcpy(stream->tail, tail, m);
+	stream->taillen = m;
+	memset(tail, 0, m);
+
+	__stream_crypt(stream, (char *)(out), (char *)(out), written, false);
+	return (int)(written);
+}
+
+bool ecc_decrypt_final(ECC_Stream stream)
+{
+	bool rc;
+
+	if (stream == NULL)
+		return false;
+
+	if (stream->taillen != stream->maclen) {
+		__warning("Encrypted data too short in ecc_decrypt_final()");
+		ecc_free_stream(stream);
+		return false;
+	}
+
+	rc = __stream_check(stream, stream->tail);
+
+	ecc_free_stream(stream);
+	return rc;
+}
+
+/*
+ * Decrypt `len` bytes of header, ciphertext and MAC into `out`, which may
+ * overlap the ciphertext. If `legacy_mac` is given, the MAC over no data 
+ * at all written by older versions of ecc_encrypt() is accepted too, and
+ * `*legacy_mac` tells whether that is what matched; GCM payloads never 
+ * had that problem
+ *
+ * The ciphertext is MACed and decrypted in the same pass, so `out` is 
+ * wiped again if the MAC turns out not to match
+ */
+static int __decrypt_into(const void *encrypted, unsigned int len, void *out,
+		bool *legacy_mac, ECC_KeyPair keypair, ECC_State state)
+{
+	ECC_Stream stream;
+	gcry_md_hd_t empty = NULL;
+	const char *block;
+	unsigned int hlen, maclen;
+	char mac[GCM_TAG_SIZE];
+	bool valid, legacy = false;
+	int rc = -1;
+
+	if ( (encrypted == NULL) || (out == NULL) ) {
+		__warning("Invalid buffers passed to ecc_decrypt_into()");
+		return -1;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid state passed to ecc_decrypt_into()");
+		return -1;
+	}
+
+	hlen = state->curveparams->pk_len_bin;
+	if (len < hlen) {
+		__warning("Encrypted data too short in ecc_decrypt_into()");
+		return -1;
+	}
+	maclen = (*(const char *)(encrypted) & ECIES_AEAD_FLAG) ? GCM_TAG_SIZE : 
+		DEFAULT_MAC_LEN;
+	if (len < hlen + maclen) {
+		__warning("Encrypted data too short in ecc_decrypt_into()");
+		return -1;
+	}
+	len -= hlen + maclen;
+
+	if (!(stream = ecc_decrypt_init(encrypted, keypair, state)))
+		return -1;
+
+	if ( (legacy_mac) && (!stream->aead) && 
+			(gcry_err_code(gcry_md_copy(&empty, stream->digest))) ) {
+		__warning("Couldn't copy the HMAC-SHA256 handle");
+		ecc_free_stream(stream);
+		return -1;
+	}
+
+	/*
+	 * `out` may overwrite the MAC, so keep a copy of it
+	 */
+	block = (const char *)(encrypted) + hlen;
+	memcpy(mac, block + len, maclen);
+
+	__stream_crypt(stream, block, (char *)(out), len, false);
+
+	valid = __stream_check(stream, mac);
+	if (empty) {
+		gcry_md_final(empty);
+		legacy = __mac_equal(gcry_md_read(empty, 0), mac);
+		gcry_md_close(empty);
+	}
+
+	if (legacy_mac)
+		*legacy_mac = !valid && legacy;
+	if (valid | legacy)
+		rc = (int)(len);
+	else {
+		memset(out, 0, len);
+		__warning("MAC mismatch, the encrypted data has been tampered with");
+	}
+
+	memset(mac, 0, maclen);
+	ecc_free_stream(stream);
+	return rc;
+}
+
+int ecc_decrypt_into(const void *encrypted, unsigned int len, void *out,
+		ECC_KeyPair keypair, ECC_State state)
+{
+	return __decrypt_into(encrypted, len, out, NULL, keypair, state);
+}
+
+ECC_Data ecc_decrypt(ECC_Data encrypted, ECC_KeyPair keypair, ECC_State state)
+{
+	ECC_Data rc = NULL;
+	bool legacy_mac;
+	int len;
+
+	if ( (encrypted == NULL) || (encrypted->data == NULL) ) {
+		__warning("Invalid `encrypted` argument passed to ecc_decrypt()");
+		return NULL;
+	}
+
+	rc = ecc_new_data();
+	if (!rc)
+		return NULL;
+
+	rc->data = (void *)(malloc(sizeof(char) * (encrypted->datalen + 1)));
+	if (!rc->data) {
+		if (errno == ENOMEM)
+			__warning("Cannot allocate memory for `rc->data` in ecc_decrypt()");
+		ecc_free_data(rc);
+		return NULL;
+	}
+
+	/*
+	 * Data written by older versions of ecc_encrypt() carries the MAC of
+	 * no data at all, which doesn't protect the ciphertext; it is only 
+	 * accepted if the caller asked for it through ::ECC_Options
+	 */
+	legacy_mac = (state != NULL) && (state->options != NULL) && 
+		(state->options->legacy_mac);
+	len = __decrypt_into(encrypted->data, encrypted->datalen, rc->data, 
+			legacy_mac ? &rc->legacy_mac : NULL, keypair, state);
+	if (len < 0) {
+		ecc_free_data(rc);
+		return NULL;
+	}
+	if (rc->legacy_mac)
+		__warning("Accepted a MAC that doesn't cover the ciphertext in ecc_decrypt()");
+	rc->datalen = len;
+	((char *)rc->data)[len] = '\0';
+
+	return rc;
+}
+
+unsigned int ecc_mac_len(ECC_State state)
+{
+	if (__payload(state) == ECC_PAYLOAD_GCM)
+		return GCM_TAG_SIZE;
+	return DEFAULT_MAC_LEN;
+}
+
+unsigned int ecc_encrypted_len(unsigned int databytes, ECC_State state)
+{
+	return state->curveparams->pk_len_bin + databytes + ecc_mac_len(state);
+}
+
+bool ecc_encrypt_into(const void *data, unsigned int databytes, void *out, 
+		ECC_KeyPair keypair, ECC_State state)
+{
+	ECC_Stream stream;
+	char *header = (char *)(out);
+	unsigned int hlen;
+
+	if ( (data == NULL) || (out == NULL) ) {
+		__warning("Invalid buffers passed to ecc_encrypt_into()");
+		return false;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid or uninitialized ECC_State object");
+		return false;
+	}
+
+	/*
+	 * Encrypting in place moves the plaintext up by the header, which 
+	 * ecc_encrypt_update() copes with; the header itself must only be 
+	 * written once the plaintext is out of its way
+	 */
+	hlen = state->curveparams->pk_len_bin;
+	if ( ((const char *)(data) < header + hlen) && 
+			((const char *)(data) + databytes > header) ) {
+		__warning("`data` overlaps the header in ecc_encrypt_into()");
+		return false;
+	}
+
+	if (!(stream = ecc_encrypt_init(header, keypair, state)))
+		return false;
+	ecc_encrypt_update(stream, data, header + hlen, databytes);
+	return ecc_encrypt_final(stream, header + hlen + databytes);
+}
+
+ECC_Data ecc_encrypt(void *data, int databytes, ECC_KeyPair keypair, ECC_State state)
+{
+	ECC_Data rc = NULL;
+
+	if ( (data == NULL) || (databytes < 0) ) {
+		__warning("Invalid or empty `data` argument passed to ecc_encrypt()");
+		return NULL;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid or uninitialized ECC_State object");
+		return NULL;
 	}
 
 	rc = ecc_new_data();
-	serialized = (char *)(malloc(sizeof(char) * 
-			(1 + state->curveparams->sig_len_compact)));
+	if (!rc)
+		return NULL;
+
+	rc->datalen = ecc_encrypted_len(databytes, state);
+	rc->data = (void *)(malloc(sizeof(char) * rc->datalen));
+
+	if (!rc->data) {
+		if (errno == ENOMEM) 
+			__warning("Cannot allocate memory for `rc->data` in ecc_encrypt()");
+		ecc_free_data(rc);
+		return NULL;
+	}
+
+	if (!ecc_encrypt_into(data, databytes, rc->data, keypair, state)) {
+		ecc_free_data(rc);
+		return NULL;
+	}
+	return rc;
+}
+
+/*
+ * Recipients are encrypted to ENCRYPT_BATCH at a time, the ephemeral
+ * points of a batch sharing one field inversion
+ */
+#define ENCRYPT_BATCH 64
+
+bool ecc_encrypt_many(const void *data, unsigned int databytes, void *out,
+		ECC_KeyPair *keypairs, unsigned int count, ECC_State state)
+{
+	const struct wnaf_table *tabs[ENCRYPT_BATCH];
+	struct affine_point R[ENCRYPT_BATCH];
+	ECC_Stream stream;
+	char *keybuf, *header = (char *)(out);
+	unsigned int hlen, msglen, i, j, m;
+	bool aead, rc = true;
+
+	if ( (data == NULL) || (out == NULL) || (keypairs == NULL) ) {
+		__warning("Invalid buffers passed to ecc_encrypt_many()");
+		return false;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid or uninitialized ECC_State object");
+		return false;
+	}
+
+	hlen = state->curveparams->pk_len_bin;
+	msglen = ecc_encrypted_len(databytes, state);
+	aead = __payload(state) == ECC_PAYLOAD_GCM;
+	if ( ((const char *)(data) < header + (size_t)(count) * msglen) && 
+			((const char *)(data) + databytes > header) ) {
+		__warning("`data` overlaps `out` in ecc_encrypt_many()");
+		return false;
+	}
+	if (!(keybuf = gcry_malloc_secure(64 * ENCRYPT_BATCH))) {
+		__warning("Out of secure memory!");
+		return false;
+	}
+
+	for (i = 0; (rc) && (i < count); i += m) {
+		m = count - i < ENCRYPT_BATCH ? count - i : ENCRYPT_BATCH;
+		for (j = 0; (rc) && (j < m); ++j) {
+			if ( (!__verify_keypair(keypairs[i + j], false, true)) || 
+					(!(tabs[j] = __keypair_table(keypairs[i + j], state))) ) {
+				__warning("Invalid ECC_KeyPair object passed to ecc_encrypt_many()");
+				rc = false;
+			}
+		}
+		if (!rc)
+			break;
+
+		ECIES_encryption_batch(keybuf, R, tabs, m, state->curveparams);
+
+		for (j = 0; j < m; ++j, header += msglen) {
+			compress_to_string(header, DF_BIN, &R[j], state->curveparams);
+			point_release(&R[j]);
+			if (aead)
+				header[0] |= ECIES_AEAD_FLAG;
+
+			if ( (rc) && (stream = __new_stream(keybuf + 64 * j, aead)) ) {
+				__stream_crypt(stream, (const char *)(data), header + hlen, 
+						databytes, true);
+				ecc_encrypt_final(stream, header + hlen + databytes);
+			}
+			else
+				rc = false;
+		}
+	}
+
+	memset(keybuf, 0, 64 * ENCRYPT_BATCH);
+	gcry_free(keybuf);
+	return rc;
+}
+
+/*
+ * Hash `len` bytes of data and sign the digest, shared by ecc_sign() and
+ * ecc_sign_bin()
+ */
+static gcry_mpi_t __sign(const void *data, unsigned int len, 
+		ECC_KeyPair keypair, ECC_State state)
+{
+	char digest[64];
+	gcry_mpi_t signature;
+
+	if (!__verify_keypair(keypair, true, false)) {
+		__warning("Invalid ECC_KeyPair object passed to ecc_sign()");
+		return NULL;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid or uninitialized ECC_State object");
+		return NULL;
+	}
+
+	gcry_md_hash_buffer(GCRY_MD_SHA512, digest, data, len);
+
+	signature = ECDSA_sign(digest, keypair->priv, state->curveparams);
+
+	if (signature == NULL)
+		__warning("ECDSA_sign() returned a NULL signature");
+	return signature;
+}
+
+/*
+ * Serialize a signature into a new ::ECC_Data of `len` bytes, plus a
+ * terminating NUL
+ */
+static ECC_Data __signature_data(gcry_mpi_t signature, enum disp_format df,
+		unsigned int len)
+{
+	ECC_Data rc = ecc_new_data();
+	char *serialized;
+
+	if (!rc)
+		return NULL;
+
+	serialized = (char *)(malloc(sizeof(char) * (1 + len)));
 
 	if (!serialized) {
 		if (errno == ENOMEM)
 			__warning("Cannot allocate memory for `serialized` in ecc_sign()");
 		ecc_free_data(rc);
-		rc = NULL;
-		goto bailout;
+		return NULL;
 	}
 
-	serialize_mpi(serialized, state->curveparams->sig_len_compact, 
-			DF_COMPACT, signature);
-	serialized[state->curveparams->sig_len_compact] = '\0';
+	serialize_mpi(serialized, len, df, signature);
+	serialized[len] = '\0';
 	rc->data = serialized;
-	
-	bailout:
-		gcry_mpi_release(signature);
-		gcry_md_close(digest);
-	exit:
-		return rc;
+	rc->datalen = len;
+	return rc;
+}
+
+ECC_Data ecc_sign(char *data, ECC_KeyPair keypair, ECC_State state)
+{
+	ECC_Data rc = NULL;
+	gcry_mpi_t signature;
+
+	/* 
+	 * Preliminary argument checks, just for sanity of the library 
+	 */
+	if (!data) {
+		__warning("Invalid or empty `data` argument passed to ecc_sign()");
+		return NULL;
+	}
+
+	if (!(signature = __sign(data, strlen(data), keypair, state)))
+		return NULL;
+
+	rc = __signature_data(signature, DF_COMPACT, 
+			state->curveparams->sig_len_compact);
+	gcry_mpi_release(signature);
+	return rc;
+}
+
+ECC_Data ecc_sign_bin(const void *data, unsigned int datalen, 
+		ECC_KeyPair keypair, ECC_State state)
+{
+	ECC_Data rc = NULL;
+	gcry_mpi_t signature;
+
+	if ( (!data) && (datalen) ) {
+		__warning("Invalid or empty `data` argument passed to ecc_sign_bin()");
+		return NULL;
+	}
+
+	if (!(signature = __sign(data, datalen, keypair, state)))
+		return NULL;
+
+	rc = __signature_data(signature, DF_BIN, state->curveparams->sig_len_bin);
+	gcry_mpi_release(signature);
+	return rc;
+}
+
+/*
+ * Check a deserialized signature over `len` bytes of data, shared by 
+ * ecc_verify() and ecc_verify_bin()
+ */
+static bool __verify(const void *data, unsigned int len, gcry_mpi_t signature,
+		ECC_KeyPair keypair, ECC_State state)
+{
+	const struct wnaf_table *tab;
+	char digest[64];
+
+	if (!(tab = __keypair_table(keypair, state))) {
+		__warning("Your public key appears invalid");
+		return false;
+	}
+
+	gcry_md_hash_buffer(GCRY_MD_SHA512, digest, data, len);
+
+	if (ECDSA_verify_precomp(digest, tab, signature, state->curveparams))
+		return true;
+	return false;
 }
 
 bool ecc_verify(char *data, char *signature, ECC_KeyPair keypair, ECC_State state)
 {
 	bool rc = false;
-	struct affine_point _ap;
-	gcry_error_t err = 0;
 	gcry_mpi_t deserialized_sig;
-	gcry_md_hd_t digest;
-	char *digest_buf = NULL;
-	int result = 0;
 
 	/*
 	 * Preliminary argument checks, just for sanity of the library
 	 */
 	if ( (data == NULL) ) {
 		__warning("Invalid or empty `data` argument passed to ecc_verify()");
-		goto exit;
+		return false;
 	}
 	if ( (signature == NULL) || (strlen(signature) == 0) ) {
 		__warning("Invalid or empty `signature` argument passed to ecc_verify()");
-		goto exit;
+		return false;
 	}
 
 	if (!__verify_keypair(keypair, false, true)) {
 		__warning("Invalid ECC_KeyPair object passed to ecc_verify()");
+		return false;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid or uninitialized ECC_State object");
+		return false;
+	}
+
+	if (!deserialize_mpi(&deserialized_sig, DF_COMPACT, signature, 
+						strlen(signature))) {
+		__warning("Failed to deserialize the signature");
+		return false;
+	}
+
+	rc = __verify(data, strlen(data), deserialized_sig, keypair, state);
+	gcry_mpi_release(deserialized_sig);
+	return rc;
+}
+
+bool ecc_verify_bin(const void *data, unsigned int datalen, 
+		const void *signature, unsigned int siglen, ECC_KeyPair keypair, 
+		ECC_State state)
+{
+	bool rc = false;
+	gcry_mpi_t deserialized_sig;
+
+	if ( (data == NULL) && (datalen) ) {
+		__warning("Invalid `data` argument passed to ecc_verify_bin()");
+		return false;
+	}
+	if (!__verify_keypair(keypair, false, true)) {
+		__warning("Invalid ECC_KeyPair object passed to ecc_verify_bin()");
+		return false;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid or uninitialized ECC_State object");
+		return false;
+	}
+	if ( (signature == NULL) || (siglen != state->curveparams->sig_len_bin) ) {
+		__warning("Invalid `signature` argument passed to ecc_verify_bin()");
+		return false;
+	}
+
+	if (!deserialize_mpi(&deserialized_sig, DF_BIN, signature, siglen)) {
+		__warning("Failed to deserialize the signature");
+		return false;
+	}
+
+	rc = __verify(data, datalen, deserialized_sig, keypair, state);
+	gcry_mpi_release(deserialized_sig);
+	return rc;
+}
+
+/*
+ * Whether two keypairs carry the same encoded public key
+ */
+static bool __same_public_key(ECC_KeyPair a, ECC_KeyPair b, ECC_State state)
+{
+	if (a == b)
+		return true;
+	if (a->pub_bin != b->pub_bin)
+		return false;
+	if (a->pub_bin)
+		return (a->pub_bytes == b->pub_bytes) && 
+			(!memcmp(a->pub, b->pub, a->pub_bytes));
+	return !strncmp(a->pub, b->pub, state->curveparams->pk_len_compact);
+}
+
+bool ecc_verify_batch(char **data, char **signatures, ECC_KeyPair *keypairs,
+		bool *results, unsigned int count, ECC_State state)
+{
+	bool rc = false;
+	gcry_error_t err = 0;
+	gcry_md_hd_t digest;
+	const struct wnaf_table **Q = NULL;
+	const struct wnaf_table *tab;
+	ECC_KeyPair *distinct = NULL;
+	gcry_mpi_t *sigs = NULL;
+	char *digests = NULL;
+	int *res = NULL;
+	unsigned int i, j, nkeys = 0;
+
+	/*
+	 * Preliminary argument checks, just for sanity of the library
+	 */
+	if ( (data == NULL) || (signatures == NULL) || (keypairs == NULL) || 
+			(results == NULL) ) {
+		__warning("Invalid arrays passed to ecc_verify_batch()");
 		goto exit;
 	}
+	for (i = 0; i < count; ++i)
+		results[i] = false;
 	if (!__verify_state(state)) {
 		__warning("Invalid or uninitialized ECC_State object");
 		goto exit;
 	}
+	if (count == 0)
+		return true;
 
-	if (!decompress_from_string(&_ap, keypair->pub, DF_COMPACT, 
-			state->curveparams)) {
-		__warning("Your public key appears invalid");
-		goto exit;
+	Q = (const struct wnaf_table **)(calloc(count, sizeof(struct wnaf_table *)));
+	distinct = (ECC_KeyPair *)(malloc(sizeof(ECC_KeyPair) * count));
+	sigs = (gcry_mpi_t *)(calloc(count, sizeof(gcry_mpi_t)));
+	digests = (char *)(malloc(sizeof(char) * 64 * count));
+	res = (int *)(malloc(sizeof(int) * count));
+
+	if ( (!Q) || (!distinct) || (!sigs) || (!digests) || (!res) ) {
+		if (errno == ENOMEM)
+			__warning("Cannot allocate memory in ecc_verify_batch()");
+		goto bailout;
 	}
 
 	err = gcry_md_open(&digest, GCRY_MD_SHA512, 0);
@@ -709,41 +1753,125 @@ bool ecc_verify(char *data, char *signature, ECC_KeyPair keypair, ECC_State stat
 		goto bailout;
 	}
 
-	/*
-	 * Write our data into the message digest buffer for gcrypt
-	 */
-	gcry_md_write(digest, data, strlen(data));
-	gcry_md_final(digest);
-	digest_buf = (char *)(gcry_md_read(digest, 0));
+	for (i = 0; i < count; ++i) {
+		if ( (data[i] == NULL) || (signatures[i] == NULL) || 
+				(strlen(signatures[i]) == 0) ||
+				(!__verify_keypair(keypairs[i], false, true)) )
+			continue;
+
+		/*
+		 * Use a single keypair (and its cached public key table) for
+		 * every copy of the same public key
+		 */
+		for (j = 0; j < nkeys; ++j) {
+			if (__same_public_key(distinct[j], keypairs[i], state))
+				break;
+		}
+		if (!(tab = __keypair_table(j < nkeys ? distinct[j] : keypairs[i], 
+				state))) {
+			__warning("Your public key appears invalid");
+			continue;
+		}
+		if (j == nkeys)
+			distinct[nkeys++] = keypairs[i];
 
-	result = deserialize_mpi(&deserialized_sig, DF_COMPACT, signature, 
-						strlen(signature));
-	if (!result) {
-		__warning("Failed to deserialize the signature");
-		goto bailout;
+		if (!deserialize_mpi(&sigs[i], DF_COMPACT, signatures[i], 
+					strlen(signatures[i]))) {
+			sigs[i] = NULL;
+			continue;
+		}
+
+		/*
+		 * Reuse the same message digest handle for every item
+		 */
+		gcry_md_reset(digest);
+		gcry_md_write(digest, data[i], strlen(data[i]));
+		gcry_md_final(digest);
+		memcpy(digests + 64 * i, gcry_md_read(digest, 0), 64);
+		Q[i] = tab;
 	}
+	gcry_md_close(digest);
 
-	result = ECDSA_verify(digest_buf, &_ap, deserialized_sig, state->curveparams);
-	if (result)
-		rc = true;
-	/*
-	 * Calling gcry_mpi_release() here after we're certain we have an object
-	 * and we're certain that it's valid. I don't *think* that this should 
-	 * case a leak in the case above if `result` doesn't exist and we bailout.
-	 *
-	 * Calling gcry_mpi_release() will cause a double free() if placed in bailout
-	 * most likely because somebody inside libgcrypt isn't checking members for NULL
-	 * prior to free()
-	 */
-	gcry_mpi_release(deserialized_sig);
+	ECDSA_verify_batch(res, digests, Q, sigs, count, state->curveparams);
+
+	rc = true;
+	for (i = 0; i < count; ++i) {
+		results[i] = res[i] ? true : false;
+		rc = rc && results[i];
+	}
 
 	bailout:
-		point_release(&_ap);
-		gcry_md_close(digest);
+		if (sigs) {
+			for (i = 0; i < count; ++i)
+				gcry_mpi_release(sigs[i]);
+		}
+		free(Q);
+		free(distinct);
+		free(sigs);
+		free(digests);
+		free(res);
 	exit:
 		return rc;
 }
 
+ECC_Data ecc_public_key_bin(ECC_KeyPair kp, ECC_State state)
+{
+	const struct wnaf_table *tab;
+	ECC_Data rc;
+
+	if (!__verify_keypair(kp, false, true)) {
+		__warning("Invalid KeyPair passed to ecc_public_key_bin()");
+		return NULL;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid state passed to ecc_public_key_bin()");
+		return NULL;
+	}
+	if (!(tab = __keypair_table(kp, state))) {
+		__warning("Your public key appears invalid");
+		return NULL;
+	}
+
+	if (!(rc = ecc_new_data()))
+		return NULL;
+	rc->datalen = state->curveparams->pk_len_bin;
+	if (!(rc->data = malloc(rc->datalen))) {
+		if (errno == ENOMEM)
+			__warning("Cannot allocate memory in ecc_public_key_bin()");
+		ecc_free_data(rc);
+		return NULL;
+	}
+	compress_to_string((char *)(rc->data), DF_BIN, &tab->point, 
+			state->curveparams);
+	return rc;
+}
+
+ECC_Data ecc_private_key_bin(ECC_KeyPair kp, ECC_State state)
+{
+	ECC_Data rc;
+
+	if (!__verify_keypair(kp, true, false)) {
+		__warning("Invalid KeyPair passed to ecc_private_key_bin()");
+		return NULL;
+	}
+	if (!__verify_state(state)) {
+		__warning("Invalid state passed to ecc_private_key_bin()");
+		return NULL;
+	}
+
+	if (!(rc = ecc_new_data()))
+		return NULL;
+	rc->datalen = state->curveparams->order_len_bin;
+	if (!(rc->data = malloc(rc->datalen))) {
+		if (errno == ENOMEM)
+			__warning("Cannot allocate memory in ecc_private_key_bin()");
+		ecc_free_data(rc);
+		return NULL;
+	}
+	serialize_mpi((char *)(rc->data), rc->datalen, DF_BIN, kp->priv);
+	return rc;
+}
+
 char *ecc_serialize_private_key(ECC_KeyPair kp, ECC_State state)
 {
 	char *buf = NULL;
@@ -36,23 +36,54 @@
 
 #define DEFAULT_MAC_LEN 10
 
+/**
+ * Symmetric schemes ecc_encrypt() and friends can wrap the payload in
+ *
+ * ::ECC_PAYLOAD_CTR_HMAC is AES-256-CTR with a ::DEFAULT_MAC_LEN byte 
+ * HMAC-SHA256, the format every version of seccure reads. 
+ * ::ECC_PAYLOAD_GCM is AES-256-GCM with a 16 byte tag, which needs 
+ * libgcrypt 1.6 or later and is flagged in the ciphertext header, so 
+ * decryption picks the right scheme on its own
+ */
+enum ecc_payload {
+	ECC_PAYLOAD_CTR_HMAC,
+	ECC_PAYLOAD_GCM
+};
+
+struct wnaf_table;
+
 /**
  * ::ECC_KeyPair denotes a structure to hold the public/private
  * keys necessary for ECC sign/verify/encrypt and decrypting.
+ *
+ * The public key is decoded and its multiples precomputed the first time
+ * the keypair is used to encrypt or verify; `pub_table` and `pub_curve`
+ * hold that cache and are released by ecc_free_keypair(). The keypair
+ * should only be used with states on that same curve afterwards
+ *
+ * `pub_bin` is set for keypairs made by ecc_new_keypair_bin(), whose `pub`
+ * holds the pk_len_bin byte binary encoding instead of the compact string
  */
 struct _ECC_KeyPair {
 	gcry_mpi_t priv;
 	void *pub;
 	unsigned int pub_bytes;
+	struct wnaf_table *pub_table;
+	const char *pub_curve;
+	bool pub_bin;
 };
 typedef struct _ECC_KeyPair* ECC_KeyPair;
 
 /**
  * ::ECC_Data is simply a shortcut to an allocated void pointer
+ *
+ * `legacy_mac` is set by ecc_decrypt() when the data was only accepted
+ * because of ::_ECC_Options::legacy_mac, so its integrity is unchecked
  */
 struct _ECC_Data {
 	void *data;
 	unsigned int datalen;
+	bool legacy_mac;
 };
 typedef struct _ECC_Data* ECC_Data;
 
@@ -63,16 +94,23 @@ typedef struct _ECC_Data* ECC_Data;
 struct _ECC_Options {
 	char *curve; /*!< curve will be defaulted to ::DEFAULT_CURVE by ecc_new_options() */
 	bool secure_random; /*!< secure_random enables libgcrypt's secure random number generator, default true */
+	enum ecc_payload payload; /*!< payload selects the scheme new ciphertexts are encrypted with, default ::ECC_PAYLOAD_CTR_HMAC */
+	bool legacy_mac; /*!< legacy_mac lets ecc_decrypt() accept data from older versions of ecc_encrypt(), whose MAC doesn't cover the ciphertext, default false */
 }; 
 typedef struct _ECC_Options* ECC_Options;
 
 /**
  * ::ECC_State is a bag of useful bits for maintaining cross-function state
+ *
+ * A state is not modified after ecc_new_state() returns and its curve 
+ * parameters are shared, read-only, with every other state on that curve,
+ * so one state may be used by several threads at once. Each call keeps its
+ * temporaries on its own stack and heap.
  */
 struct _ECC_State {
 	bool gcrypt_init;
 	ECC_Options options;
-	struct curve_params *curveparams;
+	const struct curve_params *curveparams;
 };
 typedef struct _ECC_State* ECC_State;
 
@@ -94,6 +132,18 @@ ECC_KeyPair ecc_new_keypair(char *pubkey, char *privkey, ECC_State state);
  */
 ECC_KeyPair ecc_new_keypair_s(char *pubkey, unsigned int pubkeylen, char *privkey, 
 	unsigned int privkeylen, ECC_State state);
+/**
+ * Allocate an ::ECC_KeyPair from binary (DF_BIN) keys, as returned by
+ * ecc_public_key_bin() and ecc_private_key_bin()
+ *
+ * Like ecc_new_keypair_s(), the public key buffer is referenced and not 
+ * copied, so it has to outlive the keypair. Either key may be NULL
+ *
+ * @param pubkey The compressed public point, pk_len_bin bytes
+ * @param privkey The private exponent, big-endian
+ */
+ECC_KeyPair ecc_new_keypair_bin(void *pubkey, unsigned int pubkeylen,
+	const void *privkey, unsigned int privkeylen, ECC_State state);
 /**
  * Free and release an ::ECC_KeyPair
  */
@@ -138,6 +188,41 @@ void ecc_free_state(ECC_State state);
  */
 ECC_KeyPair ecc_keygen(void *priv, ECC_State state);
 
+/**
+ * Generate n random ECC public/private key pairs at once
+ *
+ * The keys are drawn like those of ecc_keygen(), but the public points are
+ * computed in chunks whose conversion to affine coordinates shares a single
+ * field inversion, which makes bulk provisioning considerably cheaper
+ *
+ * @return An allocated array of n ::ECC_KeyPair objects, or NULL on failure.
+ * Release it with ecc_free_keypairs()
+ * @param n Number of key pairs to generate
+ * @param state ::ECC_State object
+ */
+ECC_KeyPair *ecc_keygen_batch(unsigned int n, ECC_State state);
+
+/**
+ * Generate n new key pairs like ecc_keygen_batch(), spread over a pool of
+ * worker threads that share the curve's fixed-base table. No more threads
+ * are started than there are full batches of keys to generate
+ *
+ * @return An allocated array of n ::ECC_KeyPair objects, or NULL on failure.
+ * Release it with ecc_free_keypairs()
+ * @param n Number of key pairs to generate
+ * @param state ::ECC_State object, shared read-only by the workers
+ * @param threads Maximum number of worker threads; 0 or 1 generates the
+ * keys on the calling thread
+ */
+ECC_KeyPair *ecc_keygen_many(unsigned int n, ECC_State state,
+		unsigned int threads);
+
+/**
+ * Free an array returned by ecc_keygen_batch() or ecc_keygen_many(),
+ * including the keypairs and their public key buffers
+ */
+void ecc_free_keypairs(ECC_KeyPair *keys, unsigned int n);
+
 
 /**
  * Return an allocated buffer with an GCRYMPI_FMT_HEX formatted
@@ -151,6 +236,22 @@ const char *ecc_mpi_to_str(gcry_mpi_t key);
 
 char *ecc_serialize_private_key(ECC_KeyPair kp, ECC_State state);
 
+/**
+ * Return the binary (DF_BIN) encoding of the keypair's public key, 
+ * pk_len_bin bytes of compressed point, for use with ecc_new_keypair_bin()
+ *
+ * @return An allocated ::ECC_Data, or NULL on failure
+ */
+ECC_Data ecc_public_key_bin(ECC_KeyPair kp, ECC_State state);
+
+/**
+ * Return the binary (DF_BIN) encoding of the keypair's private key, 
+ * order_len_bin bytes, for use with ecc_new_keypair_bin()
+ *
+ * @return An allocated ::ECC_Data, or NULL on failure
+ */
+ECC_Data ecc_private_key_bin(ECC_KeyPair kp, ECC_State state);
+
 
 /**
  * Encrypt the specified block of data using the public key specified
@@ -163,10 +264,165 @@ ECC_Data ecc_encrypt(void *data, int databytes, ECC_KeyPair keypair, ECC_State s
 /**
  * Decrypt the specied block of data using the private key specified
  *
- * @return An allocated buffer with the decrypted data
+ * The MAC is checked like ecc_decrypt_into() does. Data from versions of
+ * ecc_encrypt() which MACed no data at all is only accepted if the state's
+ * ::ECC_Options have `legacy_mac` set; the result then has its own 
+ * `legacy_mac` set, since such data may have been tampered with
+ *
+ * @return An allocated buffer with the decrypted data, NULL if the MAC 
+ * doesn't match
  */
 ECC_Data ecc_decrypt(ECC_Data encrypted, ECC_KeyPair keypair, ECC_State state);
 
+/**
+ * Return the length of the MAC (or GCM tag) that follows the ciphertext
+ * when encrypting with the payload scheme of the state's ::ECC_Options
+ */
+unsigned int ecc_mac_len(ECC_State state);
+
+/**
+ * Return the size of the buffer ecc_encrypt_into() needs for `databytes`
+ * bytes of plaintext: the header, the ciphertext and the ecc_mac_len() 
+ * byte MAC
+ */
+unsigned int ecc_encrypted_len(unsigned int databytes, ECC_State state);
+
+/**
+ * Encrypt the specified block of data into a caller-provided buffer
+ *
+ * To encrypt in place, put the plaintext at `out` + pk_len_bin and leave
+ * ecc_mac_len() bytes of room after it
+ *
+ * @return True/False
+ * @param out Buffer of ecc_encrypted_len() bytes receiving the header,
+ * ciphertext and MAC
+ */
+bool ecc_encrypt_into(const void *data, unsigned int databytes, void *out, 
+	ECC_KeyPair keypair, ECC_State state);
+
+/**
+ * Encrypt the same block of data to many recipients at once
+ *
+ * Message i, laid out like the output of ecc_encrypt_into(), is written
+ * to `out` + i * ecc_encrypted_len(`databytes`). The ephemeral keys of 
+ * up to 64 recipients are computed together, sharing one field inversion,
+ * and the cipher and MAC handles are re-keyed rather than reopened for 
+ * each message, which makes fanning a short message out to many keys 
+ * considerably cheaper than calling ecc_encrypt() in a loop
+ *
+ * @return True/False
+ * @param out Buffer of `count` * ecc_encrypted_len() bytes, which must not
+ * overlap `data`
+ * @param keypairs Array of `count` ::ECC_KeyPair objects holding the 
+ * recipients' public keys (the same object may be repeated)
+ * @param count Number of recipients
+ * @param state ::ECC_State object
+ */
+bool ecc_encrypt_many(const void *data, unsigned int databytes, void *out,
+	ECC_KeyPair *keypairs, unsigned int count, ECC_State state);
+
+/**
+ * Decrypt and authenticate the specified block of data into a 
+ * caller-provided buffer
+ *
+ * `out` needs room for `len` - pk_len_bin bytes and may point into 
+ * `encrypted` to decrypt in place. The payload scheme is read from the 
+ * header. The ciphertext is MACed and decrypted in one pass, so on a MAC 
+ * mismatch `out` is zeroed
+ *
+ * @return The length of the plaintext, or -1 on failure (including a MAC
+ * that doesn't match)
+ */
+int ecc_decrypt_into(const void *encrypted, unsigned int len, void *out,
+	ECC_KeyPair keypair, ECC_State state);
+
+
+/**
+ * ::ECC_Stream holds the state of an incremental encryption or decryption
+ * started with ecc_encrypt_init() or ecc_decrypt_init()
+ *
+ * A stream produces (or consumes) a header of pk_len_bin bytes for the
+ * state's curve, the ciphertext, and a MAC of ::DEFAULT_MAC_LEN bytes 
+ * computed over the ciphertext, the same layout the seccure-encrypt tool
+ * writes with its default MAC length. With ::ECC_PAYLOAD_GCM the MAC is
+ * the 16 byte GCM tag instead, as seccure-encrypt -g writes it
+ */
+typedef struct _ECC_Stream* ECC_Stream;
+
+/**
+ * Start encrypting a stream of data to the public key specified
+ *
+ * @return A new ::ECC_Stream, or NULL on failure
+ * @param header Buffer receiving the pk_len_bin byte header that has to 
+ * precede the ciphertext
+ * @param keypair ::ECC_KeyPair holding the recipient's public key
+ * @param state ::ECC_State object
+ */
+ECC_Stream ecc_encrypt_init(char *header, ECC_KeyPair keypair, ECC_State state);
+
+/**
+ * Encrypt the next `len` bytes of the stream from `in` into `out`, which
+ * may be the same buffer
+ *
+ * @return True/False
+ */
+bool ecc_encrypt_update(ECC_Stream stream, const void *in, void *out, 
+	unsigned int len);
+
+/**
+ * Finish an encryption stream, writing its MAC and releasing the stream
+ *
+ * @return True/False
+ * @param mac Buffer receiving the ecc_mac_len() byte MAC that has to 
+ * follow the ciphertext
+ */
+bool ecc_encrypt_final(ECC_Stream stream, char *mac);
+
+/**
+ * Start decrypting a stream of data using the private key specified
+ *
+ * @return A new ::ECC_Stream, or NULL on failure
+ * @param header The pk_len_bin byte header written by ecc_encrypt_init()
+ * @param keypair ::ECC_KeyPair holding the private key
+ * @param state ::ECC_State object
+ */
+ECC_Stream ecc_decrypt_init(const char *header, ECC_KeyPair keypair, 
+	ECC_State state);
+
+/**
+ * Decrypt the next `len` bytes of ciphertext (and MAC) from `in` into `out`,
+ * which may be the same buffer
+ *
+ * The stream can't tell the trailing MAC from the ciphertext until it has
+ * seen the end of the data, so it holds back the last MAC length worth of 
+ * bytes it was given. Feed everything after the header to this function.
+ *
+ * @return The number of plaintext bytes written to `out` (never more than 
+ * `len`), or -1 on error
+ */
+int ecc_decrypt_update(ECC_Stream stream, const void *in, void *out, 
+	unsigned int len);
+
+/**
+ * Finish a decryption stream, checking the MAC and releasing the stream
+ *
+ * Plaintext returned by ecc_decrypt_update() must not be trusted until 
+ * this returns true
+ *
+ * @return True if the data was not tampered with
+ */
+bool ecc_decrypt_final(ECC_Stream stream);
+
+/**
+ * Abandon and release an ::ECC_Stream without finishing it
+ *
+ * Released streams keep their open cipher and MAC handles in a per-thread
+ * cache for the next stream that thread starts, re-keyed with zeros in the
+ * meantime. The cache is emptied when its thread exits or when the last 
+ * ::ECC_State is freed, so every stream has to be released before that
+ */
+void ecc_free_stream(ECC_Stream stream);
+
 
 /**
  * Sign the specified block of data using the private key specified
@@ -191,4 +447,58 @@ ECC_Data ecc_sign(char *data, ECC_KeyPair keypair, ECC_State state);
  */
 bool ecc_verify(char *data, char *signature, ECC_KeyPair keypair, ECC_State state);
 
+/**
+ * Sign `datalen` bytes of data like ecc_sign(), returning the signature in
+ * binary (DF_BIN) form instead of compact text
+ *
+ * @return An allocated ::ECC_Data holding sig_len_bin bytes of signature
+ * @param data Buffer to generate a signature against, may contain NULs
+ * @param datalen Number of bytes in "data"
+ * @param keypair ::ECC_KeyPair to use when generating the signature 
+ * (only needs "priv" member to contain data)
+ * @param state ::ECC_State object
+ */
+ECC_Data ecc_sign_bin(const void *data, unsigned int datalen, 
+	ECC_KeyPair keypair, ECC_State state);
+
+/**
+ * Verify a binary signature made by ecc_sign_bin()
+ *
+ * The data is hashed the same way by ecc_sign() and ecc_sign_bin(), so a
+ * signature can be converted between the two forms and verified with 
+ * either function
+ *
+ * @return True/False
+ * @param data Buffer against which to verify the signature
+ * @param datalen Number of bytes in "data"
+ * @param signature The binary signature
+ * @param siglen Length of "signature", which must be sig_len_bin
+ * @param keypair ::ECC_KeyPair object (only needs the "pub" member to contain data)
+ * @param state ::ECC_State object
+ */
+bool ecc_verify_bin(const void *data, unsigned int datalen, 
+	const void *signature, unsigned int siglen, ECC_KeyPair keypair, 
+	ECC_State state);
+
+/**
+ * Verify a batch of signatures, item i being the signature "signatures[i]" of
+ * "data[i]" under the public key of "keypairs[i]"
+ *
+ * Every distinct public key is decoded only once and the work that does not
+ * depend on the individual message is shared across the whole batch, which
+ * makes this considerably cheaper than calling ecc_verify() in a loop when
+ * the data comes from a small set of signers.
+ *
+ * @return True if every signature in the batch verified
+ * @param data Array of "count" buffers against which to verify the signatures
+ * @param signatures Array of "count" ECC generated signatures
+ * @param keypairs Array of "count" ::ECC_KeyPair objects (only the "pub" 
+ * member needs to contain data, the same object may be repeated)
+ * @param results Array of "count" bools receiving the per-item result
+ * @param count Number of items in the batch
+ * @param state ::ECC_State object
+ */
+bool ecc_verify_batch(char **data, char **signatures, ECC_KeyPair *keypairs,
+		bool *results, unsigned int count, ECC_State state);
+
 #endif
@@ -111,3 +111,33 @@ int mod_root(gcry_mpi_t x, const gcry_mpi_t a, const gcry_mpi_t p)
   gcry_mpi_release(t);
   return 1;
 }
+
+/* Montgomery's simultaneous inversion: x[i] = a[i]^-1 mod p for all i at the
+   cost of a single inversion and 3(n - 1) multiplications. Zero entries
+   yield zero. The x[i] must be allocated and must not alias the a[i].       */
+void mod_inv_batch(gcry_mpi_t *x, const gcry_mpi_t *a, int n, 
+		   const gcry_mpi_t p)
+{
+  gcry_mpi_t u;
+  int i;
+  u = gcry_mpi_snew(0);
+  gcry_mpi_set_ui(u, 1);
+  for(i = 0; i < n; i++) {
+    if (gcry_mpi_cmp_ui(a[i], 0))
+      gcry_mpi_mulm(u, u, a[i], p);
+    gcry_mpi_set(x[i], u);
+  }
+  gcry_mpi_invm(u, u, p);
+  for(i = n - 1; i >= 0; i--) {
+    if (! gcry_mpi_cmp_ui(a[i], 0)) {
+      gcry_mpi_set_ui(x[i], 0);
+      continue;
+    }
+    if (i)
+      gcry_mpi_mulm(x[i], u, x[i - 1], p);
+    else
+      gcry_mpi_set(x[i], u);
+    gcry_mpi_mulm(u, u, a[i], p);
+  }
+  gcry_mpi_release(u);
+}
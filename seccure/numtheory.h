@@ -45,5 +45,7 @@
 
 int mod_issquare(const gcry_mpi_t a, const gcry_mpi_t p);
 int mod_root(gcry_mpi_t x, const gcry_mpi_t a, const gcry_mpi_t p);
+void mod_inv_batch(gcry_mpi_t *x, const gcry_mpi_t *a, int n, 
+		   const gcry_mpi_t p);
 
 #endif /* INC_NUMTHEORY_H */
@@ -40,10 +40,13 @@
 #define ECDSA_DETERMINISTIC 1
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <gcrypt.h>
 #include <assert.h>
 
 #include "ecc.h"
+#include "numtheory.h"
 #include "curves.h"
 #include "serialize.h"
 #include "aes256ctr.h"
@@ -203,7 +206,8 @@ gcry_mpi_t ECDSA_sign(const char *msg, const gcry_mpi_t d,
 
 #if ECDSA_DETERMINISTIC
   struct aes256cprng *cprng;
-  cprng = ecdsa_cprng_init(msg, d, cp);
+  if (! (cprng = ecdsa_cprng_init(msg, d, cp)))
+    return NULL;
 #endif
   r = gcry_mpi_snew(0);
   s = gcry_mpi_snew(0);
@@ -240,11 +244,32 @@ gcry_mpi_t ECDSA_sign(const char *msg, const gcry_mpi_t d,
   return s;
 }
 
-int ECDSA_verify(const char *msg, const struct affine_point *Q,
-		 const gcry_mpi_t sig, const struct curve_params *cp)
+/* The wNAF table of the base point is computed once per curve              */
+static void* base_wnaf_build(const struct curve_params *cp)
+{
+  return wnaf_table_new(&cp->dp.base, &cp->dp);
+}
+
+static void base_wnaf_release(void *tab)
+{
+  wnaf_table_release(tab);
+}
+
+static const struct wnaf_table* base_wnaf(const struct curve_params *cp)
+{
+  return curve_precomp(cp, PRECOMP_BASE_WNAF, base_wnaf_build, 
+		       base_wnaf_release);
+}
+
+/* tabQ, if given, is the wNAF table of Q built by wnaf_table_new()          */
+static int ECDSA_verify_tab(const char *msg, const struct affine_point *Q,
+			    const struct wnaf_table *tabQ, 
+			    const gcry_mpi_t sig, const struct curve_params *cp)
 {
   gcry_mpi_t e, r, s;
-  struct affine_point X1, X2;
+  const struct wnaf_table *tabG;
+  struct wnaf_table *tab = NULL;
+  struct affine_point X;
   int res = 0;
   r = gcry_mpi_new(0);
   s = gcry_mpi_new(0);
@@ -256,23 +281,105 @@ int ECDSA_verify(const char *msg, const struct affine_point *Q,
   gcry_mpi_mod(e, e, cp->dp.order);
   gcry_mpi_invm(s, s, cp->dp.order);
   gcry_mpi_mulm(e, e, s, cp->dp.order);
-  X1 = pointmul(&cp->dp.base, e, &cp->dp);
-  gcry_mpi_mulm(e, r, s, cp->dp.order);
-  X2 = pointmul(Q, e, &cp->dp);
-  point_add(&X1, &X2, &cp->dp);
+  gcry_mpi_mulm(s, r, s, cp->dp.order);
+  if ((tabG = base_wnaf(cp)) && 
+      (tabQ || (tab = wnaf_table_new(Q, &cp->dp)))) {
+    X = pointmul_joint_precomp(tabG, e, tabQ ? tabQ : tab, s, &cp->dp);
+    if (tab)
+      wnaf_table_release(tab);
+  }
+  else
+    X = pointmul_joint(&cp->dp.base, e, Q, s, &cp->dp);
   gcry_mpi_release(e);
-  if (! point_is_zero(&X1)) {
-    gcry_mpi_mod(s, X1.x, cp->dp.order);
+  if (! point_is_zero(&X)) {
+    gcry_mpi_mod(s, X.x, cp->dp.order);
     res = ! gcry_mpi_cmp(s, r);
   }
-  point_release(&X1);
-  point_release(&X2);
+  point_release(&X);
  end:
   gcry_mpi_release(r);
   gcry_mpi_release(s);
   return res;
 }
 
+int ECDSA_verify(const char *msg, const struct affine_point *Q,
+		 const gcry_mpi_t sig, const struct curve_params *cp)
+{
+  return ECDSA_verify_tab(msg, Q, NULL, sig, cp);
+}
+
+int ECDSA_verify_precomp(const char *msg, const struct wnaf_table *tabQ,
+			 const gcry_mpi_t sig, const struct curve_params *cp)
+{
+  return ECDSA_verify_tab(msg, &tabQ->point, tabQ, sig, cp);
+}
+
+/* Verifies n signatures (msgs holds n consecutive 64 byte digests) against
+   the public keys whose wNAF tables (see wnaf_table_new()) are in tabQ. The
+   inversions of all s share a single inversion. Entries with a NULL key
+   or signature fail. Returns the number of valid signatures.                 */
+int ECDSA_verify_batch(int *res, const char *msgs, 
+		       const struct wnaf_table **tabQ, const gcry_mpi_t *sigs,
+		       int n, const struct curve_params *cp)
+{
+  const struct wnaf_table *tabG;
+  struct affine_point X;
+  gcry_mpi_t *r, *s, *w, e, u;
+  int i, valid = 0;
+  for(i = 0; i < n; i++)
+    res[i] = 0;
+  r = malloc(n * sizeof(gcry_mpi_t));
+  s = malloc(n * sizeof(gcry_mpi_t));
+  w = malloc(n * sizeof(gcry_mpi_t));
+  tabG = base_wnaf(cp);
+  if (! r || ! s || ! w || ! tabG) {
+    fprintf(stderr, "Failed to allocate memory in ECDSA_verify_batch()\n");
+    goto end;
+  }
+  for(i = 0; i < n; i++) {
+    r[i] = gcry_mpi_new(0);
+    s[i] = gcry_mpi_new(0);
+    w[i] = gcry_mpi_new(0);
+    if (! tabQ[i] || ! sigs[i])
+      continue;
+    gcry_mpi_div(s[i], r[i], sigs[i], cp->dp.order, 0);
+    if (gcry_mpi_cmp_ui(s[i], 0) <= 0 || gcry_mpi_cmp(s[i], cp->dp.order) >= 0 ||
+	gcry_mpi_cmp_ui(r[i], 0) <= 0 || gcry_mpi_cmp(r[i], cp->dp.order) >= 0)
+      gcry_mpi_set_ui(s[i], 0);
+    else
+      res[i] = 1;
+  }
+  mod_inv_batch(w, s, n, cp->dp.order);
+  u = gcry_mpi_new(0);
+  for(i = 0; i < n; i++) {
+    if (! res[i])
+      continue;
+    gcry_mpi_scan(&e, GCRYMPI_FMT_USG, msgs + 64 * i, 64, NULL);
+    gcry_mpi_mod(e, e, cp->dp.order);
+    gcry_mpi_mulm(e, e, w[i], cp->dp.order);
+    gcry_mpi_mulm(u, r[i], w[i], cp->dp.order);
+    X = pointmul_joint_precomp(tabG, e, tabQ[i], u, &cp->dp);
+    gcry_mpi_release(e);
+    if ((res[i] = ! point_is_zero(&X))) {
+      gcry_mpi_mod(u, X.x, cp->dp.order);
+      res[i] = ! gcry_mpi_cmp(u, r[i]);
+    }
+    valid += res[i];
+    point_release(&X);
+  }
+  gcry_mpi_release(u);
+  for(i = 0; i < n; i++) {
+    gcry_mpi_release(r[i]);
+    gcry_mpi_release(s[i]);
+    gcry_mpi_release(w[i]);
+  }
+ end:
+  free(r);
+  free(s);
+  free(w);
+  return valid;
+}
+
 /******************************************************************************/
 
 /* Algorithms 4.42 and 4.43 in the "Guide to Elliptic Curve Cryptography"     */
@@ -291,8 +398,10 @@ static void ECIES_KDF(char *key, const gcry_mpi_t Zx,
   gcry_free(buf);
 }
 
-struct affine_point ECIES_encryption(char *key, const struct affine_point *Q, 
-				     const struct curve_params *cp)
+static struct affine_point ECIES_encryption_tab(char *key, 
+						const struct affine_point *Q,
+						const struct wnaf_table *tabQ,
+						const struct curve_params *cp)
 {
   struct affine_point Z, R;
   gcry_mpi_t k;
@@ -300,7 +409,10 @@ struct affine_point ECIES_encryption(char *key, const struct affine_point *Q,
   k = get_random_exponent(cp);
   R = pointmul(&cp->dp.base, k, &cp->dp);
   gcry_mpi_mul_ui(k, k, cp->dp.cofactor);
-  Z = pointmul(Q, k, &cp->dp);
+  if (tabQ)
+    Z = pointmul_wnaf_precomp(tabQ, k, &cp->dp);
+  else
+    Z = pointmul(Q, k, &cp->dp);
   gcry_mpi_release(k);
   if (point_is_zero(&Z)) {
     point_release(&R);
@@ -312,6 +424,48 @@ struct affine_point ECIES_encryption(char *key, const struct affine_point *Q,
   return R;
 }
 
+struct affine_point ECIES_encryption(char *key, const struct affine_point *Q, 
+				     const struct curve_params *cp)
+{
+  return ECIES_encryption_tab(key, Q, NULL, cp);
+}
+
+struct affine_point ECIES_encryption_precomp(char *key, 
+					     const struct wnaf_table *tabQ, 
+					     const struct curve_params *cp)
+{
+  return ECIES_encryption_tab(key, &tabQ->point, tabQ, cp);
+}
+
+/* ECIES_encryption_precomp() for n recipients at once: the ephemeral
+   points R[i] are computed with pointmul_base_batch(), so they share a
+   single field inversion. key receives 64 bytes per recipient          */
+void ECIES_encryption_batch(char *key, struct affine_point *R,
+			    const struct wnaf_table **tabQ, int n,
+			    const struct curve_params *cp)
+{
+  struct affine_point Z;
+  gcry_mpi_t k[n];
+  memset(k, 0, sizeof(k));
+  int i;
+  for(i = 0; i < n; i++)
+    k[i] = get_random_exponent(cp);
+  pointmul_base_batch(R, k, n, &cp->dp);
+  for(i = 0; i < n; i++) {
+    gcry_mpi_mul_ui(k[i], k[i], cp->dp.cofactor);
+    Z = pointmul_wnaf_precomp(tabQ[i], k[i], &cp->dp);
+    gcry_mpi_release(k[i]);
+    if (point_is_zero(&Z)) {
+      point_release(&R[i]);
+      R[i] = ECIES_encryption_tab(key + 64 * i, &tabQ[i]->point, tabQ[i], 
+				  cp);
+    }
+    else
+      ECIES_KDF(key + 64 * i, Z.x, &R[i], cp->elem_len_bin);
+    point_release(&Z);
+  }
+}
+
 int ECIES_decryption(char *key, const struct affine_point *R,
 		     const gcry_mpi_t d, const struct curve_params *cp)
 {
@@ -61,12 +61,28 @@ gcry_mpi_t ECDSA_sign(const char *msg, const gcry_mpi_t d,
 		      const struct curve_params *cp);
 int ECDSA_verify(const char *msg, const struct affine_point *Q, 
 		 const gcry_mpi_t sig, const struct curve_params *cp);
+int ECDSA_verify_precomp(const char *msg, const struct wnaf_table *tabQ,
+			 const gcry_mpi_t sig, const struct curve_params *cp);
+int ECDSA_verify_batch(int *res, const char *msgs, 
+		       const struct wnaf_table **tabQ, const gcry_mpi_t *sigs,
+		       int n, const struct curve_params *cp);
 
 struct affine_point ECIES_encryption(char *key, const struct affine_point *Q, 
 				     const struct curve_params *cp);
+struct affine_point ECIES_encryption_precomp(char *key, 
+					     const struct wnaf_table *tabQ, 
+					     const struct curve_params *cp);
+void ECIES_encryption_batch(char *key, struct affine_point *R,
+			    const struct wnaf_table **tabQ, int n,
+			    const struct curve_params *cp);
 int ECIES_decryption(char *key, const struct affine_point *R, 
 		     const gcry_mpi_t d, const struct curve_params *cp);
 
+/* The DF_BIN encoding of a compressed point never sets the top bit of its
+   first byte (2p - 1 has fewer than 8 * pk_len_bin bits on every curve),
+   so ciphertext headers use it to flag an AES-256-GCM payload            */
+#define ECIES_AEAD_FLAG 0x80
+
 gcry_mpi_t DH_step1(struct affine_point *A, const struct curve_params *cp);
 int DH_step2(char *key, const struct affine_point *B, const gcry_mpi_t exp, 
 	     const struct curve_params *cp);
@@ -66,6 +66,7 @@ int opt_sigcopy = 0;
 int opt_sigbin = 0;
 int opt_sigappend = 0;
 int opt_maclen = -1;
+int opt_aead = 0;
 int opt_dblprompt = 0;
 char *opt_infile = NULL;
 char *opt_outfile = NULL;
@@ -166,6 +167,7 @@ int read_block(int fd, char *buf, int len)
 }
 
 void encryption_loop(int fdin, int fdout, struct aes256ctr *ac,
+		     gcry_cipher_hd_t *gcm,
 		     gcry_md_hd_t *mh_pre, gcry_md_hd_t *mh_post)
 {
   char buf[COPYBUF_SIZE];
@@ -173,7 +175,10 @@ void encryption_loop(int fdin, int fdout, struct aes256ctr *ac,
   while ((c = read(fdin, buf, COPYBUF_SIZE)) > 0) {
     if (mh_pre)
       gcry_md_write(*mh_pre, buf, c);
-    aes256ctr_enc(ac, buf, c);
+    if (gcm)
+      gcry_cipher_encrypt(*gcm, buf, c, NULL, 0);
+    else
+      aes256ctr_enc(ac, buf, c);
     if (mh_post)
       gcry_md_write(*mh_post, buf, c);
     write_block(fdout, buf, c);
@@ -183,6 +188,7 @@ void encryption_loop(int fdin, int fdout, struct aes256ctr *ac,
 }
 
 void decryption_loop(int fdin, int fdout, struct aes256ctr *ac,
+		     gcry_cipher_hd_t *gcm,
 		     gcry_md_hd_t *mh_pre, gcry_md_hd_t *mh_post,
 		     char *tail, int taillen)
 {
@@ -193,7 +199,10 @@ void decryption_loop(int fdin, int fdout, struct aes256ctr *ac,
   while ((c = read(fdin, buf + taillen, COPYBUF_SIZE - taillen)) > 0) {
     if (mh_pre)
       gcry_md_write(*mh_pre, buf, c);
-    aes256ctr_dec(ac, buf, c);
+    if (gcm)
+      gcry_cipher_decrypt(*gcm, buf, c, NULL, 0);
+    else
+      aes256ctr_dec(ac, buf, c);
     if (mh_post)
       gcry_md_write(*mh_post, buf, c);
     write_block(fdout, buf, c);
@@ -304,7 +313,7 @@ void read_passphrase(char *hash, const char *name)
 
 void app_print_public_key(void)
 {
-	struct curve_params *cp;
+	const struct curve_params *cp;
 	if (! opt_curve) {
 		opt_curve = DEFAULT_CURVE;
 		fprintf(stderr, "Assuming curve " DEFAULT_CURVE ".\n");
@@ -346,9 +355,14 @@ void app_print_public_key(void)
 void app_encrypt(const char *pubkey)
 {
 	struct affine_point P, R;
-	struct curve_params *cp;
+	const struct curve_params *cp;
 
-	if (opt_maclen < 0) {
+	if (opt_aead) {
+		if (opt_maclen >= 0 && opt_maclen != GCM_TAG_SIZE)
+			fatal("AES256-GCM only supports a MAC length of 128 bits");
+		opt_maclen = GCM_TAG_SIZE;
+	}
+	else if (opt_maclen < 0) {
 		opt_maclen = DEFAULT_MAC_LEN;
 		fprintf(stderr, "Assuming MAC length of %d bits.\n", 8 * DEFAULT_MAC_LEN);
 	}
@@ -374,8 +388,9 @@ void app_encrypt(const char *pubkey)
 		fatal("Invalid encryption key (wrong length)");
 
 	if (decompress_from_string(&P, pubkey, DF_COMPACT, cp)) {
-		char rbuf[cp->pk_len_bin];
-		struct aes256ctr *ac;
+		char rbuf[cp->pk_len_bin], tag[GCM_TAG_SIZE];
+		struct aes256ctr *ac = NULL;
+		gcry_cipher_hd_t gh;
 		char *keybuf, *md;
 		gcry_md_hd_t mh;
 
@@ -383,6 +398,8 @@ void app_encrypt(const char *pubkey)
 			fatal("Out of secure memory");
 		R = ECIES_encryption(keybuf, &P, cp);
 		compress_to_string(rbuf, DF_BIN, &R, cp);
+		if (opt_aead)
+			rbuf[0] |= ECIES_AEAD_FLAG;
 		point_release(&P);
 		point_release(&R);
 
@@ -398,21 +415,45 @@ void app_encrypt(const char *pubkey)
 			fprintf(stderr, "\n");
 		}
 
-		if (! (ac = aes256ctr_init(keybuf)))
-			fatal("Cannot initialize AES256-CTR");
-		if (opt_maclen && ! hmacsha256_init(&mh, keybuf + 32, HMAC_KEY_SIZE))
-			fatal("Cannot initialize HMAC-SHA256");
+		if (opt_aead) {
+			if (! aes256gcm_init(&gh, keybuf, keybuf + 32))
+				fatal("Cannot initialize AES256-GCM");
+		}
+		else {
+			if (! (ac = aes256ctr_init(keybuf)))
+				fatal("Cannot initialize AES256-CTR");
+			if (opt_maclen && ! hmacsha256_init(&mh, keybuf + 32, HMAC_KEY_SIZE))
+				fatal("Cannot initialize HMAC-SHA256");
+		}
 		gcry_free(keybuf);
 
 		if (isatty(opt_fdin))
 			print_quiet("Go ahead and type your message ...\n", 0);
 
 		write_block(opt_fdout, rbuf, cp->pk_len_bin);
-		encryption_loop(opt_fdin, opt_fdout, ac, NULL, opt_maclen ? &mh : NULL);
 
-		aes256ctr_done(ac);
+		if (opt_aead) {
+			encryption_loop(opt_fdin, opt_fdout, NULL, &gh, NULL, NULL);
+			gcry_cipher_gettag(gh, tag, GCM_TAG_SIZE);
 
-		if (opt_maclen) {
+			if (opt_verbose) {
+				int i;
+				print_quiet("TAG: ", 0); 
+				for(i = 0; i < GCM_TAG_SIZE; i++)
+					fprintf(stderr, "%02x", (unsigned char)tag[i]);
+				fprintf(stderr, "\n");
+			}
+
+			write_block(opt_fdout, tag, GCM_TAG_SIZE);
+			gcry_cipher_close(gh);
+		}
+		else {
+			encryption_loop(opt_fdin, opt_fdout, ac, NULL, NULL, 
+					opt_maclen ? &mh : NULL);
+			aes256ctr_done(ac);
+		}
+
+		if (opt_maclen && ! opt_aead) {
 			gcry_md_final(mh);
 			md = (char*)gcry_md_read(mh, 0);
 
@@ -435,7 +476,7 @@ void app_encrypt(const char *pubkey)
 
 int app_decrypt(void)
 {
-	struct curve_params *cp;
+	const struct curve_params *cp;
 	struct affine_point R;
 	int res = 0;
 
@@ -452,10 +493,12 @@ int app_decrypt(void)
 	if ((cp = curve_by_name(opt_curve))) {
 		char *keybuf, *privkey;
 		char rbuf[cp->pk_len_bin];
-		char mdbuf[opt_maclen], *md;
+		char mdbuf[opt_maclen > GCM_TAG_SIZE ? opt_maclen : GCM_TAG_SIZE], *md;
 		struct aes256ctr *ac;
+		gcry_cipher_hd_t gh;
 		gcry_md_hd_t mh;
 		gcry_mpi_t d;
+		int aead;
 
 		if (opt_verbose) {
 			print_quiet("VERSION: ", 0);
@@ -476,6 +519,8 @@ int app_decrypt(void)
 			print_quiet("Go ahead and enter the ciphertext ...\n", 0);
 
 		if (read_block(opt_fdin, rbuf, cp->pk_len_bin)) {
+			aead = rbuf[0] & ECIES_AEAD_FLAG;
+			rbuf[0] &= ~ECIES_AEAD_FLAG;
 			if (decompress_from_string(&R, rbuf, DF_BIN, cp)) {
 				if (! (keybuf = gcry_malloc_secure(64)))
 					fatal("Out of secure memory");
@@ -493,44 +538,70 @@ int app_decrypt(void)
 						fprintf(stderr, "\n");
 					}
 
-					if (! (ac = aes256ctr_init(keybuf)))
-						fatal("Cannot initialize AES256-CTR");
-					if (opt_maclen && ! hmacsha256_init(&mh, keybuf + 32, HMAC_KEY_SIZE))
-						fatal("Cannot initialize HMAC-SHA256");
-					memset(keybuf, 0x00, 64);
+					if (aead) {
+						if (! aes256gcm_init(&gh, keybuf, keybuf + 32))
+							fatal("Cannot initialize AES256-GCM");
+						memset(keybuf, 0x00, 64);
 
-					decryption_loop(opt_fdin, opt_fdout, ac, opt_maclen ? &mh : NULL, 
-								NULL, mdbuf, opt_maclen);
-
-					aes256ctr_done(ac);
-
-					if (opt_maclen) {
-						gcry_md_final(mh);
-						md = (char*)gcry_md_read(mh, 0);
+						decryption_loop(opt_fdin, opt_fdout, NULL, &gh, NULL, NULL, 
+									mdbuf, GCM_TAG_SIZE);
 
 						if (opt_verbose) {
 							int i;
-							print_quiet("HMAC1: ", 0); 
-							for(i = 0; i < opt_maclen; i++)
-								fprintf(stderr, "%02x", (unsigned char)md[i]);
-							fprintf(stderr, "\n");
-							print_quiet("HMAC2: ", 0); 
-							for(i = 0; i < opt_maclen; i++)
+							print_quiet("TAG: ", 0); 
+							for(i = 0; i < GCM_TAG_SIZE; i++)
 								fprintf(stderr, "%02x", (unsigned char)mdbuf[i]);
 							fprintf(stderr, "\n");
 						}
 
-						if ((res = ! memcmp(mdbuf, md, opt_maclen)))
+						if ((res = ! gcry_err_code(gcry_cipher_checktag(gh, mdbuf, 
+												GCM_TAG_SIZE))))
 							print_quiet("Integrity check successful, message unforged!\n", 0);
 						else
 							print_quiet("Integrity check failed, message forged!\n", 1);
 
-						gcry_md_close(mh);
+						gcry_cipher_close(gh);
 					}
 					else {
-						res = 1;
-						print_quiet("Warning: No MAC available, message integrity cannot "
-								"be verified!\n", 0);
+						if (! (ac = aes256ctr_init(keybuf)))
+							fatal("Cannot initialize AES256-CTR");
+						if (opt_maclen && ! hmacsha256_init(&mh, keybuf + 32, HMAC_KEY_SIZE))
+							fatal("Cannot initialize HMAC-SHA256");
+						memset(keybuf, 0x00, 64);
+
+						decryption_loop(opt_fdin, opt_fdout, ac, NULL, 
+									opt_maclen ? &mh : NULL, NULL, mdbuf, opt_maclen);
+
+						aes256ctr_done(ac);
+
+						if (opt_maclen) {
+							gcry_md_final(mh);
+							md = (char*)gcry_md_read(mh, 0);
+
+							if (opt_verbose) {
+								int i;
+								print_quiet("HMAC1: ", 0); 
+								for(i = 0; i < opt_maclen; i++)
+									fprintf(stderr, "%02x", (unsigned char)md[i]);
+								fprintf(stderr, "\n");
+								print_quiet("HMAC2: ", 0); 
+								for(i = 0; i < opt_maclen; i++)
+									fprintf(stderr, "%02x", (unsigned char)mdbuf[i]);
+								fprintf(stderr, "\n");
+							}
+
+							if ((res = ! memcmp(mdbuf, md, opt_maclen)))
+								print_quiet("Integrity check successful, message unforged!\n", 0);
+							else
+								print_quiet("Integrity check failed, message forged!\n", 1);
+
+							gcry_md_close(mh);
+						}
+						else {
+							res = 1;
+							print_quiet("Warning: No MAC available, message integrity cannot "
+									"be verified!\n", 0);
+						}
 					}
 				}
 				else
@@ -554,7 +625,7 @@ int app_decrypt(void)
 
 void app_sign(void)
 {
-	struct curve_params *cp;
+	const struct curve_params *cp;
 	char *privkey, *md;
 	gcry_md_hd_t mh;
 	gcry_error_t err;
@@ -652,7 +723,7 @@ void app_sign(void)
 
 int app_verify(const char *pubkey, const char *sig)
 {
-	struct curve_params *cp;
+	const struct curve_params *cp;
 	struct affine_point Q;
 	gcry_mpi_t s;
 	gcry_md_hd_t mh;
@@ -784,7 +855,7 @@ int app_verify(const char *pubkey, const char *sig)
 
 void app_signcrypt(const char *pubkey)
 {
-  struct curve_params *cp_enc, *cp_sig;
+  const struct curve_params *cp_enc, *cp_sig;
   struct affine_point P, R;
 
   if (! opt_curve) {
@@ -856,7 +927,7 @@ void app_signcrypt(const char *pubkey)
       print_quiet("Go ahead and type your message ...\n", 0);
 
     write_block(opt_fdout, rbuf, cp_enc->pk_len_bin);
-    encryption_loop(opt_fdin, opt_fdout, ac, &mh, NULL);
+    encryption_loop(opt_fdin, opt_fdout, ac, NULL, &mh, NULL);
 
     gcry_md_final(mh);
     md = (char*)gcry_md_read(mh, 0);
@@ -889,7 +960,7 @@ void app_signcrypt(const char *pubkey)
 
 int app_veridec(const char *pubkey)
 {
-  struct curve_params *cp_enc, *cp_sig;
+  const struct curve_params *cp_enc, *cp_sig;
   struct affine_point Q, R;
   int res = 0;
 
@@ -961,7 +1032,7 @@ int app_veridec(const char *pubkey)
 	  if (gcry_err_code(err))
 	    fatal_gcrypt("Cannot initialize SHA512", err);
 
-	  decryption_loop(opt_fdin, opt_fdout, ac, NULL, &mh,
+	  decryption_loop(opt_fdin, opt_fdout, ac, NULL, NULL, &mh,
 			  sigbuf, cp_sig->sig_len_bin);
 
 	  gcry_md_final(mh);
@@ -1012,7 +1083,7 @@ int app_veridec(const char *pubkey)
 
 void app_dh(void)
 {
-  struct curve_params *cp;
+  const struct curve_params *cp;
 
   if (! opt_curve) {
     opt_curve = DEFAULT_CURVE;
@@ -1133,12 +1204,13 @@ int main(int argc, char **argv)
   if ((progname = strrchr(argv[0], '/')) == NULL)
     progname = argv[0];
   
-  while((i = getopt(argc, argv, "fbadm:i:o:F:s:c:hvq")) != -1)
+  while((i = getopt(argc, argv, "fbadgm:i:o:F:s:c:hvq")) != -1)
     switch(i) {
     case 'f': opt_sigcopy = 1; break;
     case 'b': opt_sigbin = 1; break;
     case 'a': opt_sigappend = 1; break;
     case 'd': opt_dblprompt = 1; break;
+    case 'g': opt_aead = 1; break;
     case 'm':
       opt_maclen = atoi(optarg); 
       if (opt_maclen < 0 || opt_maclen > 256 || opt_maclen % 8)
@@ -1194,7 +1266,7 @@ int main(int argc, char **argv)
     if (opt_help || optind != argc - 1)
       puts("Encrypt a message with a public key (seccure version" VERSION ").\n"
 	   "\n"
-	   "seccure-encrypt [-m maclen] [-c curve] [-i infile] [-o outfile] key");
+	   "seccure-encrypt [-m maclen] [-g] [-c curve] [-i infile] [-o outfile] key");
     else
       app_encrypt(argv[optind]);
   }
@@ -1261,6 +1333,7 @@ int main(int argc, char **argv)
   if (opt_fdpw != opt_fdin)
     close(opt_fdpw);
 
+  curve_registry_cleanup();
   gcry_control(GCRYCTL_TERM_SECMEM, 1);
   exit(res);
 }
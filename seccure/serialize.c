@@ -38,9 +38,13 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <gcrypt.h>
 #include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "serialize.h"
 
@@ -55,6 +59,246 @@ const char compact_digits[COMPACT_DIGITS_COUNT] = {
   'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 
   'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '{', '|', '}', '~' };
 
+/* Reverse of compact_digits[]: the value of each character, -1 if it is
+   not a compact digit                                                    */
+static const signed char compact_values[256] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1,  0, -1,  1,  2,  3,  4, -1,  5,  6,  7,  8,  9, 10, 11, 12,
+  13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28,
+  29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44,
+  45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, -1, 57, 58, 59,
+  -1, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74,
+  75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 88, 89, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+/* Check that buf consists of compact digits only.  These are the ASCII
+   characters 33..126 without '"', '\'', '\\' and '`', which SSE2 can test
+   sixteen at a time                                                      */
+static int compact_valid(const char *buf, int len)
+{
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i lo = _mm_set1_epi8(32), hi = _mm_set1_epi8(127);
+  const __m128i q1 = _mm_set1_epi8('"'), q2 = _mm_set1_epi8('\''),
+    bs = _mm_set1_epi8('\\'), bq = _mm_set1_epi8('`');
+  for(; i + 16 <= len; i += 16) {
+    __m128i c = _mm_loadu_si128((const __m128i *)(buf + i));
+    __m128i bad = _mm_or_si128(_mm_cmpgt_epi8(lo, c), _mm_cmpeq_epi8(c, lo));
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi8(c, hi));
+    bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmpeq_epi8(c, q1), 
+					 _mm_cmpeq_epi8(c, q2)));
+    bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmpeq_epi8(c, bs), 
+					 _mm_cmpeq_epi8(c, bq)));
+    if (_mm_movemask_epi8(bad))
+      return 0;
+  }
+#endif
+  for(; i < len; i++)
+    if (compact_values[(unsigned char)buf[i]] < 0)
+      return 0;
+  return 1;
+}
+
+/******************************************************************************/
+
+/* The compact codec converts between big-endian byte strings and base-90
+   digit strings on an array of 32 bit words.  Instead of one bignum
+   division per digit, each pass divides (or multiplies) the whole array
+   by CHUNK = 90^4 < 2^32 and so handles four digits at once.             */
+
+#define CHUNK_DIGITS 4
+#define CHUNK ((uint32_t)COMPACT_DIGITS_COUNT * COMPACT_DIGITS_COUNT * \
+	       COMPACT_DIGITS_COUNT * COMPACT_DIGITS_COUNT)
+
+/* Numbers up to this many words are converted without malloc()           */
+#define STACK_WORDS 64
+
+struct words {
+  uint32_t *w;
+  int n;                        /* number of significant words */
+  int size;
+  uint32_t stack[STACK_WORDS];
+};
+
+static int words_init(struct words *a, int size)
+{
+  a->size = size;
+  a->n = 0;
+  a->w = size <= STACK_WORDS ? a->stack : malloc(size * sizeof(uint32_t));
+  return a->w != NULL;
+}
+
+/* The words may hold a private key, so they are wiped before release     */
+static void words_release(struct words *a)
+{
+  volatile uint32_t *w = a->w;
+  int i;
+  for(i = 0; i < a->size; i++)
+    w[i] = 0;
+  if (a->w != a->stack)
+    free(a->w);
+}
+
+static void words_from_bytes(struct words *a, const unsigned char *in, 
+			     int inlen)
+{
+  int i;
+  memset(a->w, 0, a->size * sizeof(uint32_t));
+  for(i = 0; i < inlen; i++)
+    a->w[i / 4] |= (uint32_t)in[inlen - 1 - i] << (8 * (i % 4));
+  for(a->n = a->size; a->n && ! a->w[a->n - 1]; a->n--);
+}
+
+static int words_to_bytes(unsigned char *out, int outlen, 
+			  const struct words *a)
+{
+  int i;
+  for(i = 8 * outlen; i < 32 * a->n; i += 8)
+    if ((a->w[i / 32] >> (i % 32)) & 0xff)
+      return 0;
+  for(i = 0; i < outlen; i++)
+    out[outlen - 1 - i] = i / 4 < a->n ? a->w[i / 4] >> (8 * (i % 4)) : 0;
+  return 1;
+}
+
+/* a = a / CHUNK, returns a % CHUNK                                       */
+static uint32_t words_divmod_chunk(struct words *a)
+{
+  uint64_t cur = 0;
+  int i;
+  for(i = a->n - 1; i >= 0; i--) {
+    cur = (cur << 32) | a->w[i];
+    a->w[i] = cur / CHUNK;
+    cur %= CHUNK;
+  }
+  for(; a->n && ! a->w[a->n - 1]; a->n--);
+  return cur;
+}
+
+/* a = a * m + c, returns 0 if the result does not fit                    */
+static int words_muladd(struct words *a, uint32_t m, uint32_t c)
+{
+  uint64_t cur = c;
+  int i;
+  for(i = 0; i < a->n; i++) {
+    cur += (uint64_t)a->w[i] * m;
+    a->w[i] = cur;
+    cur >>= 32;
+  }
+  if (cur) {
+    if (a->n == a->size)
+      return 0;
+    a->w[a->n++] = cur;
+  }
+  return 1;
+}
+
+int compact_encode(char *outbuf, int outlen, const unsigned char *in, 
+		   int inlen)
+{
+  struct words a;
+  uint32_t rem = 0;
+  int i = outlen, k;
+  if (! words_init(&a, (inlen + 3) / 4))
+    return 0;
+  words_from_bytes(&a, in, inlen);
+  while(i > 0 && a.n) {
+    rem = words_divmod_chunk(&a);
+    for(k = 0; k < CHUNK_DIGITS && i > 0; k++) {
+      outbuf[--i] = compact_digits[rem % COMPACT_DIGITS_COUNT];
+      rem /= COMPACT_DIGITS_COUNT;
+    }
+    if (rem)
+      break;
+  }
+  k = ! a.n && ! rem;
+  words_release(&a);
+  memset(outbuf, compact_digits[0], i);
+  return k;
+}
+
+int compact_decode(unsigned char *out, int outlen, const char *buf, 
+		   int inlen)
+{
+  struct words a;
+  uint32_t chunk, mult;
+  int i = 0, k, len, res = 0;
+  if (! compact_valid(buf, inlen) || ! words_init(&a, (outlen + 3) / 4 + 1))
+    return 0;
+  memset(a.w, 0, a.size * sizeof(uint32_t));
+  for(len = inlen % CHUNK_DIGITS ? inlen % CHUNK_DIGITS : CHUNK_DIGITS; 
+      i < inlen; len = CHUNK_DIGITS) {
+    for(k = 0, chunk = 0, mult = 1; k < len; k++, i++) {
+      chunk = chunk * COMPACT_DIGITS_COUNT + 
+	compact_values[(unsigned char)buf[i]];
+      mult *= COMPACT_DIGITS_COUNT;
+    }
+    if (! words_muladd(&a, mult, chunk))
+      goto out;
+  }
+  res = words_to_bytes(out, outlen, &a);
+ out:
+  words_release(&a);
+  return res;
+}
+
+int compact_len(const unsigned char *in, int inlen)
+{
+  struct words a;
+  uint32_t rem;
+  int res = 0;
+  if (! words_init(&a, (inlen + 3) / 4))
+    return -1;
+  words_from_bytes(&a, in, inlen);
+  while(a.n) {
+    rem = words_divmod_chunk(&a);
+    if (a.n)
+      res += CHUNK_DIGITS;
+    else
+      for(; rem; rem /= COMPACT_DIGITS_COUNT)
+	res++;
+  }
+  words_release(&a);
+  return res;
+}
+
+/* Upper bound of the number of bytes a string of len digits decodes to,
+   using log2(90) < 6.5                                                   */
+#define COMPACT_MAX_BYTES(len) (((len) * 13 + 15) / 16)
+
+/* Export |x| big-endian into a buffer of (nbits + 7) / 8 bytes, which is
+   in *buf if it fits there and allocated otherwise                       */
+static unsigned char *mpi_bytes(unsigned char *buf, int buflen, int *len,
+				const gcry_mpi_t x)
+{
+  unsigned char *res = buf;
+  *len = (gcry_mpi_get_nbits(x) + 7) / 8;
+  if (*len > buflen && ! (res = gcry_malloc_secure(*len)))
+    return NULL;
+  gcry_mpi_print(GCRYMPI_FMT_USG, res, *len, NULL, x);
+  return res;
+}
+
+static void mpi_bytes_release(unsigned char *bytes, unsigned char *buf, 
+			      int len)
+{
+  volatile unsigned char *p = bytes;
+  int i;
+  for(i = 0; i < len; i++)
+    p[i] = 0;
+  if (bytes != buf)
+    gcry_free(bytes);
+}
+
 int get_serialization_len(const gcry_mpi_t x, enum disp_format df)
 {
   int res = 0;
@@ -63,13 +307,12 @@ int get_serialization_len(const gcry_mpi_t x, enum disp_format df)
     res = (gcry_mpi_get_nbits(x) + 7) / 8;
     break;
   case DF_COMPACT: do {
-      gcry_mpi_t base, Q;
-      base = gcry_mpi_set_ui(NULL, COMPACT_DIGITS_COUNT);
-      Q = gcry_mpi_copy(x);
-      for(res = 0; gcry_mpi_cmp_ui(Q, 0); res++)
-	gcry_mpi_div(Q, NULL, Q, base, 0);
-      gcry_mpi_release(base);
-      gcry_mpi_release(Q);
+      unsigned char buf[4 * STACK_WORDS], *bytes;
+      int len;
+      bytes = mpi_bytes(buf, sizeof(buf), &len, x);
+      assert(bytes);
+      res = compact_len(bytes, len);
+      mpi_bytes_release(bytes, buf, len);
     } while (0);
     break;
   default:
@@ -91,25 +334,13 @@ void serialize_mpi(char *outbuf, int outlen, enum disp_format df,
     } while (0);
     break;
   case DF_COMPACT: do {
-      gcry_mpi_t base, Q, R;
-      int i;
-      base = gcry_mpi_set_ui(NULL, COMPACT_DIGITS_COUNT);
-      Q = gcry_mpi_copy(x);
-      R = gcry_mpi_snew(0);
-      for(i = outlen - 1; i >= 0; i--) {
-        unsigned char digit = 0;
-        gcry_mpi_div(Q, R, Q, base, 0);
-        gcry_mpi_print(GCRYMPI_FMT_USG, &digit, 1, NULL, R);
-        assert(digit < COMPACT_DIGITS_COUNT);
-        outbuf[i] = compact_digits[digit];
-      }
-
-      if (gcry_mpi_cmp_ui(Q, 0)) {
-        fprintf(stderr, "Failed to execute gcry_mpi_cmp_ui()\n");
-      }
-      gcry_mpi_release(base);
-      gcry_mpi_release(Q);
-      gcry_mpi_release(R);
+      unsigned char buf[4 * STACK_WORDS], *bytes;
+      int len;
+      bytes = mpi_bytes(buf, sizeof(buf), &len, x);
+      assert(bytes);
+      if (! compact_encode(outbuf, outlen, bytes, len))
+        fprintf(stderr, "Value does not fit into %d compact digits\n", outlen);
+      mpi_bytes_release(bytes, buf, len);
     } while (0);
     break;
   default: 
@@ -126,18 +357,24 @@ int deserialize_mpi(gcry_mpi_t *x, enum disp_format df, const char *buf,
     gcry_mpi_set_flag(*x, GCRYMPI_FLAG_SECURE);
     break;
   case DF_COMPACT: do {
-      char *d;
-      int i;
-      *x = gcry_mpi_snew(0);
-      for(i = 0; i < inlen; i++) {
-	if (! (d = memchr(compact_digits, buf[i], COMPACT_DIGITS_COUNT))) {
-	  gcry_mpi_release(*x);
-	  *x = NULL;
-	  return 0;
-	}
-	gcry_mpi_mul_ui(*x, *x, COMPACT_DIGITS_COUNT);
-	gcry_mpi_add_ui(*x, *x, d - compact_digits);
+      unsigned char stackbuf[4 * STACK_WORDS], *bytes = stackbuf;
+      int len = COMPACT_MAX_BYTES(inlen), res;
+      if (len > (int)sizeof(stackbuf) && ! (bytes = gcry_malloc_secure(len)))
+	return 0;
+      if ((res = compact_decode(bytes, len, buf, inlen)))
+	gcry_mpi_scan(x, GCRYMPI_FMT_USG, bytes, len, NULL);
+      mpi_bytes_release(bytes, stackbuf, len);
+      if (! res) {
+	*x = NULL;
+	return 0;
+      }
+      /* libgcrypt refuses to flag a zero that still owns limbs */
+      if (! gcry_mpi_cmp_ui(*x, 0)) {
+	gcry_mpi_release(*x);
+	*x = gcry_mpi_snew(0);
       }
+      else
+	gcry_mpi_set_flag(*x, GCRYMPI_FLAG_SECURE);
     } while (0);
     break;
   default: 
@@ -42,6 +42,7 @@
 #ifndef INC_SERIALIZE_H
 #define INC_SERIALIZE_H
 
+#include <stdint.h>
 #include <gcrypt.h>
 
 enum disp_format { DF_BIN, DF_COMPACT };
@@ -49,6 +50,17 @@ enum disp_format { DF_BIN, DF_COMPACT };
 #define COMPACT_DIGITS_COUNT 90
 extern const char compact_digits[];
 
+/* Compact (base-90) codec on big-endian byte strings: compact_encode()
+   writes exactly outlen digits, padded with compact_digits[0], and returns
+   0 if the number needs more; compact_decode() returns 0 on a character
+   outside compact_digits[] or if the number needs more than outlen bytes;
+   compact_len() counts the significant digits of a number               */
+int compact_encode(char *outbuf, int outlen, const unsigned char *in, 
+		   int inlen);
+int compact_decode(unsigned char *out, int outlen, const char *buf, 
+		   int inlen);
+int compact_len(const unsigned char *in, int inlen);
+
 int get_serialization_len(const gcry_mpi_t x, enum disp_format df);
 void serialize_mpi(char *outbuf, int outlen, enum disp_format df, 
 		   const gcry_mpi_t x);
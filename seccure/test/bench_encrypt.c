@@ -0,0 +1,146 @@
+/*
+ *  bench_encrypt - Copyright 2009 Slide, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Measures the per-message cost of the symmetric part of ECIES for small
+ * payloads, opening fresh AES-256-CTR and HMAC-SHA256 handles for every
+ * message against re-keying one set of handles, next to the full
+ * ecc_encrypt() and ecc_decrypt() round trip
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gcrypt.h>
+
+#include "libseccure.h"
+#include "aes256ctr.h"
+
+#define LOOPS 20000
+#define ECC_LOOPS 200
+
+#define DEFAULT_PUBKEY "#&M=6cSQ}m6C(hUz-7j@E=>oS#TL3F[F[a[q9S;RhMh+F#gP|Q6R}lhT_e7b"
+#define DEFAULT_PRIVKEY "!!![t{l5N^uZd=Bg(P#N|PH#IN8I0,Jq/PvdVNi^PxR,(5~p-o[^hPE#40.<|"
+
+static const unsigned int sizes[] = { 64, 256, 512, 1024, 4096, 0 };
+
+static double __now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Microseconds per message encrypted and MACed with handles opened and
+ * closed around every message, the way every message used to be
+ */
+static double __time_open(char *keybuf, char *buf, unsigned int len)
+{
+	struct aes256ctr *ac;
+	gcry_md_hd_t mh;
+	unsigned int i;
+	double start = __now();
+
+	for (i = 0; i < LOOPS; ++i) {
+		keybuf[0] = (char)(i);
+		ac = aes256ctr_init(keybuf);
+		hmacsha256_init(&mh, keybuf + 32, HMAC_KEY_SIZE);
+		aes256ctr_enc(ac, buf, len);
+		gcry_md_write(mh, buf, len);
+		gcry_md_final(mh);
+		buf[0] ^= gcry_md_read(mh, 0)[0];
+		gcry_md_close(mh);
+		aes256ctr_done(ac);
+	}
+	return (__now() - start) * 1e6 / LOOPS;
+}
+
+/*
+ * Microseconds per message with one set of handles re-keyed per message
+ */
+static double __time_rekey(char *keybuf, char *buf, unsigned int len)
+{
+	struct aes256ctr *ac = aes256ctr_init(keybuf);
+	gcry_md_hd_t mh;
+	unsigned int i;
+	double start;
+
+	hmacsha256_init(&mh, keybuf + 32, HMAC_KEY_SIZE);
+	start = __now();
+	for (i = 0; i < LOOPS; ++i) {
+		keybuf[0] = (char)(i);
+		aes256ctr_rekey(ac, keybuf);
+		hmacsha256_rekey(mh, keybuf + 32, HMAC_KEY_SIZE);
+		aes256ctr_enc(ac, buf, len);
+		gcry_md_write(mh, buf, len);
+		gcry_md_final(mh);
+		buf[0] ^= gcry_md_read(mh, 0)[0];
+	}
+	start = (__now() - start) * 1e6 / LOOPS;
+
+	gcry_md_close(mh);
+	aes256ctr_done(ac);
+	return start;
+}
+
+/*
+ * Microseconds per ecc_encrypt() and ecc_decrypt() round trip
+ */
+static double __time_ecc(ECC_KeyPair kp, ECC_State state, char *buf,
+		unsigned int len)
+{
+	ECC_Data encrypted, decrypted;
+	unsigned int i;
+	double start = __now();
+
+	for (i = 0; i < ECC_LOOPS; ++i) {
+		encrypted = ecc_encrypt(buf, len, kp, state);
+		decrypted = ecc_decrypt(encrypted, kp, state);
+		ecc_free_data(decrypted);
+		ecc_free_data(encrypted);
+	}
+	return (__now() - start) * 1e6 / ECC_LOOPS;
+}
+
+int main(int argc, char **argv)
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair kp = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, state);
+	const unsigned int *size;
+	char *keybuf = gcry_malloc_secure(64);
+	char buf[4096];
+
+	memset(keybuf, 0x5a, 64);
+	memset(buf, 0xa5, sizeof(buf));
+
+	printf("%-6s %12s %12s %12s  (us per message)\n", "bytes", "open",
+			"rekey", "ecc_encdec");
+	for (size = sizes; *size; ++size) {
+		printf("%-6u %12.2f", *size, __time_open(keybuf, buf, *size));
+		printf(" %12.2f", __time_rekey(keybuf, buf, *size));
+		printf(" %12.1f\n", __time_ecc(kp, state, buf, *size));
+	}
+
+	gcry_free(keybuf);
+	ecc_free_keypair(kp);
+	ecc_free_state(state);
+	return 0;
+}
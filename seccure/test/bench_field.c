@@ -0,0 +1,113 @@
+/*
+ *  bench_field - Copyright 2009 Slide, Inc.
+ *
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public License 
+ * as published by the Free Software Foundation; either version 2.1 of 
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, 
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY 
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License 
+ * for more details. 
+ *
+ * You should have received a copy of the GNU Lesser General Public License 
+ * along with this library; if not, write to the 
+ * Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Compares the variable-base point multiplication on the gcrypt MPIs with
+ * the fixed-limb field backends: the fast reduction of the special primes
+ * and Montgomery multiplication
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include <gcrypt.h>
+
+#include "libseccure.h"
+#include "curves.h"
+#include "ecc.h"
+#include "field.h"
+#include "protocol.h"
+
+#define LOOPS 100
+
+static const char *curve_names[] = {
+	"p112", "p128", "p160", "p192", "p224", "p256", "p384", "p521", NULL
+};
+
+static double __now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Microseconds per multiplication on a copy of the curve's domain
+ * parameters using the given field, or the MPI formulas for NULL
+ */
+static double __time_pointmul(const struct curve_params *cp,
+		struct field *field)
+{
+	struct domain_params dp = cp->dp;
+	struct affine_point p, r;
+	gcry_mpi_t exp = get_random_exponent(cp);
+	unsigned int i;
+	double start;
+
+	dp.comb = NULL;
+	dp.field = field;
+	if (field)
+		fe_from_mpi(dp.fe_a, dp.a, field);
+
+	p = pointmul(&dp.base, exp, &dp);
+	start = __now();
+	for (i = 0; i < LOOPS; ++i) {
+		r = pointmul(&p, exp, &dp);
+		point_release(&r);
+	}
+	start = (__now() - start) * 1e6 / LOOPS;
+
+	point_release(&p);
+	gcry_mpi_release(exp);
+	return start;
+}
+
+static void __print_backend(const struct curve_params *cp,
+		enum field_repr repr)
+{
+	struct field *field = field_new(cp->dp.m, repr);
+
+	if (field) {
+		printf(" %12.1f", __time_pointmul(cp, field));
+		field_release(field);
+	}
+	else
+		printf(" %12s", "-");
+}
+
+int main(int argc, char **argv)
+{
+	ECC_State state = ecc_new_state(NULL);
+	const struct curve_params *cp;
+	const char **name;
+
+	printf("%-6s %12s %12s %12s  (us per multiplication)\n", "curve",
+			"mpi", "special", "montgomery");
+	for (name = curve_names; *name; ++name) {
+		if (!(cp = curve_by_name(*name)))
+			continue;
+		printf("%-6s %12.1f", *name, __time_pointmul(cp, NULL));
+		__print_backend(cp, FIELD_SPECIAL);
+		__print_backend(cp, FIELD_MONTGOMERY);
+		printf("\n");
+		curve_release(cp);
+	}
+
+	ecc_free_state(state);
+	return 0;
+}
@@ -45,6 +45,19 @@
 
 #define DEFAULT_PLAINTEXT "This is a very very secret message!\n"
 
+/*
+ * DEFAULT_PLAINTEXT encrypted to DEFAULT_PUBKEY by a version of 
+ * ecc_encrypt() which MACed no data at all
+ */
+#define LEGACY_CIPHERTEXT \
+	"\x01\xa9\xc0\x1a\x03\x5c\x68\xd8\xea\x2c\x8f\xd6\x91\x57\x8d\xe7" \
+	"\x34\x78\x3a\x1d\xa8\x20\xee\x0e\x44\xfe\xb6\xb0\x50\x04\xbf\xd5" \
+	"\x3d\xf1\x3f\x00\x9c\x44\x77\xae\x0b\xc3\x05\x42\x75\x58\xf1\x9a" \
+	"\x05\x66\x81\xd1\x15\x8c\x80\x51\xa6\xf9\xd7\xf0\x8e\x99\xf2\x11" \
+	"\x3c\x74\xff\x92\x14\x1c\x25\x30\x57\x8e\x8f\x0a\x0a\x9e\x64\xf8" \
+	"\xff\xc7\x70\x0d\x03\xbb\x77\x7c\xb1\x68\xc9\xbd\x2b\x02\x87"
+#define LEGACY_CIPHERTEXT_LEN 95
+
 
 /**
  * __test_verify() will test the ecc_verify() function to comply with 
@@ -59,6 +72,21 @@ void __test_verify()
 	ecc_free_keypair(kp);
 }
 
+/*
+ * __test_verify_reuse() makes sure the public key cached on the
+ * ::ECC_KeyPair by the first call is reused correctly by later ones
+ */
+void __test_verify_reuse()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair kp = ecc_new_keypair(DEFAULT_PUBKEY, NULL, state);
+	g_assert(ecc_verify(DEFAULT_DATA, DEFAULT_SIG, kp, state));
+	g_assert(ecc_verify("Not the signed data", DEFAULT_SIG, kp, state) == false);
+	g_assert(ecc_verify(DEFAULT_DATA, DEFAULT_SIG, kp, state));
+	ecc_free_state(state);
+	ecc_free_keypair(kp);
+}
+
 void __test_verify_nullkp()
 {
 	g_assert(ecc_verify(DEFAULT_DATA, DEFAULT_SIG, NULL, NULL) == false);
@@ -91,6 +119,31 @@ void __test_verify_crapsig()
 	ecc_free_keypair(kp);
 }
 
+/**
+ * __test_verify_batch() will test ecc_verify_batch() with a mix of good
+ * and bad signatures sharing the same ::ECC_KeyPair
+ */
+void __test_verify_batch()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair kp = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, state);
+	ECC_KeyPair kp2 = ecc_new_keypair(DEFAULT_PUBKEY, NULL, state);
+	char *data[] = {DEFAULT_DATA, DEFAULT_DATA, "Not the signed data", DEFAULT_DATA};
+	char *sigs[] = {DEFAULT_SIG, DEFAULT_SIG, DEFAULT_SIG, "This sig is crap"};
+	ECC_KeyPair kps[] = {kp, kp2, kp, kp};
+	bool results[4];
+
+	g_assert(ecc_verify_batch(data, sigs, kps, results, 4, state) == false);
+	g_assert(results[0] == true);
+	g_assert(results[1] == true);
+	g_assert(results[2] == false);
+	g_assert(results[3] == false);
+
+	g_assert(ecc_verify_batch(data, sigs, kps, results, 2, state));
+	ecc_free_state(state);
+	ecc_free_keypair(kp);
+	ecc_free_keypair(kp2);
+}
 
 
 /**
@@ -121,6 +174,20 @@ void __test_new_state()
 	ecc_free_state(state);
 }
 
+/**
+ * __test_shared_curve() makes sure states on the same curve share
+ * a single set of curve parameters
+ */
+void __test_shared_curve()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_State state2 = ecc_new_state(NULL);
+	g_assert(state->curveparams != NULL);
+	g_assert(state->curveparams == state2->curveparams);
+	ecc_free_state(state);
+	ecc_free_state(state2);
+}
+
 /**
  * __test_new_data() will test ecc_new_data() and make sure it generates
  * a properly allocated but empty ::ECC_Data object
@@ -191,6 +258,85 @@ void __test_sign_nullkp()
 	ecc_free_state(state);
 }
 
+/**
+ * __test_sign_bin checks that the binary signature is the DF_BIN form of
+ * the known compact one and verifies both ways
+ */
+void __test_sign_bin()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair kp = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, state);
+	unsigned int len = state->curveparams->sig_len_bin;
+	ECC_Data result = ecc_sign_bin(DEFAULT_DATA, strlen(DEFAULT_DATA), kp, 
+			state);
+	gcry_mpi_t sig;
+	char *expected = (char *)(malloc(len));
+
+	g_assert(result != NULL);
+	g_assert(result->datalen == len);
+
+	g_assert(deserialize_mpi(&sig, DF_COMPACT, DEFAULT_SIG, 
+				strlen(DEFAULT_SIG)));
+	serialize_mpi(expected, len, DF_BIN, sig);
+	g_assert(memcmp(expected, result->data, len) == 0);
+
+	g_assert(ecc_verify_bin(DEFAULT_DATA, strlen(DEFAULT_DATA), result->data,
+				len, kp, state));
+	g_assert(ecc_verify_bin("Not the signed data", 19, result->data, len, 
+				kp, state) == false);
+	g_assert(ecc_verify_bin(DEFAULT_DATA, strlen(DEFAULT_DATA), result->data,
+				len - 1, kp, state) == false);
+
+	gcry_mpi_release(sig);
+	free(expected);
+	ecc_free_data(result);
+	ecc_free_keypair(kp);
+	ecc_free_state(state);
+}
+
+/**
+ * __test_keypair_bin round-trips the keys through their binary encoding
+ * and uses the result in place of the compact keypair
+ */
+void __test_keypair_bin()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair kp = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, state);
+	ECC_Data pub = ecc_public_key_bin(kp, state);
+	ECC_Data priv = ecc_private_key_bin(kp, state);
+	ECC_KeyPair binkp;
+	ECC_Data signature, encrypted, decrypted;
+
+	g_assert(pub != NULL);
+	g_assert(priv != NULL);
+	g_assert(pub->datalen == state->curveparams->pk_len_bin);
+
+	binkp = ecc_new_keypair_bin(pub->data, pub->datalen, priv->data, 
+			priv->datalen, state);
+	g_assert(binkp != NULL);
+
+	signature = ecc_sign(DEFAULT_DATA, binkp, state);
+	g_assert(signature != NULL);
+	g_assert_cmpstr(DEFAULT_SIG, ==, signature->data);
+	g_assert(ecc_verify(DEFAULT_DATA, DEFAULT_SIG, binkp, state));
+	ecc_free_data(signature);
+
+	encrypted = ecc_encrypt(DEFAULT_PLAINTEXT, strlen(DEFAULT_PLAINTEXT), 
+			binkp, state);
+	g_assert(encrypted != NULL);
+	decrypted = ecc_decrypt(encrypted, kp, state);
+	g_assert(decrypted != NULL);
+	g_assert_cmpstr(DEFAULT_PLAINTEXT, ==, decrypted->data);
+
+	ecc_free_data(encrypted);
+	ecc_free_data(decrypted);
+	ecc_free_keypair(binkp);
+	ecc_free_data(pub);
+	ecc_free_data(priv);
+	ecc_free_keypair(kp);
+	ecc_free_state(state);
+}
+
 
 /**
  * __test_keygen should test the canonical case
@@ -239,6 +385,35 @@ void __test_full_keygen()
 }
 
 
+/**
+ * __test_keygen_batch generates more keys than fit into one chunk and
+ * checks that every public key belongs to its private key
+ */
+void __test_keygen_batch()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair *keys = ecc_keygen_batch(70, state);
+	ECC_Data signature;
+	unsigned int i = 0;
+
+	g_assert(keys != NULL);
+	for (; i < 70; ++i) {
+		g_assert(keys[i] != NULL);
+		g_assert(keys[i]->pub != NULL);
+		g_assert(keys[i]->priv != NULL);
+		g_assert(strlen(keys[i]->pub) == state->curveparams->pk_len_compact);
+
+		signature = ecc_sign(DEFAULT_DATA, keys[i], state);
+		g_assert(signature != NULL);
+		g_assert(ecc_verify(DEFAULT_DATA, signature->data, keys[i], state));
+		ecc_free_data(signature);
+	}
+	g_assert(strcmp(keys[0]->pub, keys[69]->pub) != 0);
+
+	ecc_free_keypairs(keys, 70);
+	ecc_free_state(state);
+}
+
 /**
  * __test_encrypt should test the basic encryption
  * of a string of data via ECC
@@ -273,6 +448,297 @@ void __test_encrypt()
 	ecc_free_keypair(kp);
 }
 
+/*
+ * __test_encrypt_stream() will encrypt with ecc_encrypt_init/update/final()
+ * in small chunks and decrypt the result both ways
+ */
+void __test_encrypt_stream()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair kp = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, state);
+	unsigned int hlen = state->curveparams->pk_len_bin;
+	unsigned int plen = strlen(DEFAULT_PLAINTEXT);
+	unsigned int total = hlen + plen + DEFAULT_MAC_LEN;
+	unsigned int i, n, written = 0;
+	char *buf = (char *)(malloc(total));
+	char plain[64];
+	ECC_Stream stream;
+	struct _ECC_Data encrypted;
+	ECC_Data decrypted;
+	int c;
+
+	stream = ecc_encrypt_init(buf, kp, state);
+	g_assert(stream != NULL);
+	for (i = 0; i < plen; i += n) {
+		n = (plen - i < 7) ? plen - i : 7;
+		g_assert(ecc_encrypt_update(stream, DEFAULT_PLAINTEXT + i, 
+					buf + hlen + i, n));
+	}
+	g_assert(ecc_encrypt_final(stream, buf + hlen + plen));
+
+	encrypted.data = buf;
+	encrypted.datalen = total;
+	decrypted = ecc_decrypt(&encrypted, kp, state);
+	g_assert(decrypted != NULL);
+	g_assert_cmpstr(DEFAULT_PLAINTEXT, ==, decrypted->data);
+	ecc_free_data(decrypted);
+
+	stream = ecc_decrypt_init(buf, kp, state);
+	g_assert(stream != NULL);
+	for (i = hlen; i < total; i += n) {
+		n = (total - i < 5) ? total - i : 5;
+		c = ecc_decrypt_update(stream, buf + i, plain + written, n);
+		g_assert(c >= 0);
+		written += c;
+	}
+	g_assert(written == plen);
+	g_assert(memcmp(plain, DEFAULT_PLAINTEXT, plen) == 0);
+	g_assert(ecc_decrypt_final(stream));
+
+	/*
+	 * Flipping a ciphertext bit has to be caught by the MAC
+	 */
+	buf[hlen] ^= 1;
+	stream = ecc_decrypt_init(buf, kp, state);
+	g_assert(stream != NULL);
+	g_assert(ecc_decrypt_update(stream, buf + hlen, buf + hlen, 
+				plen + DEFAULT_MAC_LEN) == (int)(plen));
+	g_assert(ecc_decrypt_final(stream) == false);
+
+	free(buf);
+	ecc_free_state(state);
+	ecc_free_keypair(kp);
+}
+
+/*
+ * __test_encrypt_into() will encrypt and decrypt in place within a 
+ * caller-provided buffer
+ */
+void __test_encrypt_into()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair kp = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, state);
+	unsigned int hlen = state->curveparams->pk_len_bin;
+	unsigned int plen = strlen(DEFAULT_PLAINTEXT);
+	unsigned int total = ecc_encrypted_len(plen, state);
+	char *buf = (char *)(malloc(total));
+
+	g_assert(total == hlen + plen + DEFAULT_MAC_LEN);
+	memcpy(buf + hlen, DEFAULT_PLAINTEXT, plen);
+	g_assert(ecc_encrypt_into(buf + hlen, plen, buf, kp, state));
+	g_assert(memcmp(buf + hlen, DEFAULT_PLAINTEXT, plen) != 0);
+
+	g_assert(ecc_decrypt_into(buf, total, buf + hlen, kp, state) == (int)(plen));
+	g_assert(memcmp(buf + hlen, DEFAULT_PLAINTEXT, plen) == 0);
+
+	/*
+	 * The plaintext is gone, so re-encrypt and tamper with the MAC
+	 */
+	g_assert(ecc_encrypt_into(DEFAULT_PLAINTEXT, plen, buf, kp, state));
+	buf[total - 1] ^= 1;
+	g_assert(ecc_decrypt_into(buf, total, buf + hlen, kp, state) == -1);
+	g_assert(ecc_encrypt_into(buf, plen, buf, kp, state) == false);
+
+	free(buf);
+	ecc_free_state(state);
+	ecc_free_keypair(kp);
+}
+
+/*
+ * __test_decrypt_tampered() sends a payload spanning several MAC chunks
+ * through ecc_encrypt() and checks that ecc_decrypt() rejects it once a 
+ * single ciphertext bit has been flipped
+ */
+void __test_decrypt_tampered()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair kp = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, state);
+	unsigned int hlen = state->curveparams->pk_len_bin;
+	unsigned int i, plen = 3 * 8192 + 123;
+	char *plaintext = (char *)(malloc(plen));
+	ECC_Data encrypted, decrypted;
+
+	for (i = 0; i < plen; ++i)
+		plaintext[i] = (char)(i * 7);
+
+	encrypted = ecc_encrypt(plaintext, plen, kp, state);
+	g_assert(encrypted != NULL);
+
+	decrypted = ecc_decrypt(encrypted, kp, state);
+	g_assert(decrypted != NULL);
+	g_assert(decrypted->datalen == plen);
+	g_assert(memcmp(decrypted->data, plaintext, plen) == 0);
+	ecc_free_data(decrypted);
+
+	((char *)(encrypted->data))[hlen + 2 * 8192 + 5] ^= 1;
+	g_assert(ecc_decrypt(encrypted, kp, state) == NULL);
+
+	ecc_free_data(encrypted);
+	free(plaintext);
+	ecc_free_state(state);
+	ecc_free_keypair(kp);
+}
+
+/*
+ * __test_encrypt_gcm() will encrypt with the AES-256-GCM payload and check
+ * that decryption picks the scheme up from the header, both ways round
+ */
+void __test_encrypt_gcm()
+{
+	ECC_Options opts = ecc_new_options();
+	ECC_State gcm, ctr;
+	ECC_KeyPair kp;
+	unsigned int hlen, i, n, written = 0;
+	unsigned int plen = strlen(DEFAULT_PLAINTEXT);
+	ECC_Data encrypted, decrypted;
+	ECC_Stream stream;
+	char plain[64];
+	int c;
+
+	g_assert(opts != NULL);
+	g_assert(opts->payload == ECC_PAYLOAD_CTR_HMAC);
+	opts->payload = ECC_PAYLOAD_GCM;
+	gcm = ecc_new_state(opts);
+	ctr = ecc_new_state(NULL);
+	kp = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, gcm);
+	hlen = gcm->curveparams->pk_len_bin;
+
+	g_assert(ecc_mac_len(gcm) == 16);
+	g_assert(ecc_mac_len(ctr) == DEFAULT_MAC_LEN);
+
+	encrypted = ecc_encrypt(DEFAULT_PLAINTEXT, plen, kp, gcm);
+	g_assert(encrypted != NULL);
+	g_assert(encrypted->datalen == hlen + plen + 16);
+	g_assert(((unsigned char *)(encrypted->data))[0] & 0x80);
+
+	decrypted = ecc_decrypt(encrypted, kp, ctr);
+	g_assert(decrypted != NULL);
+	g_assert_cmpstr(DEFAULT_PLAINTEXT, ==, decrypted->data);
+	ecc_free_data(decrypted);
+
+	stream = ecc_decrypt_init(encrypted->data, kp, ctr);
+	g_assert(stream != NULL);
+	for (i = hlen; i < encrypted->datalen; i += n) {
+		n = (encrypted->datalen - i < 5) ? encrypted->datalen - i : 5;
+		c = ecc_decrypt_update(stream, (char *)(encrypted->data) + i, 
+				plain + written, n);
+		g_assert(c >= 0);
+		written += c;
+	}
+	g_assert(written == plen);
+	g_assert(memcmp(plain, DEFAULT_PLAINTEXT, plen) == 0);
+	g_assert(ecc_decrypt_final(stream));
+
+	((char *)(encrypted->data))[encrypted->datalen - 1] ^= 1;
+	g_assert(ecc_decrypt(encrypted, kp, gcm) == NULL);
+	ecc_free_data(encrypted);
+
+	/*
+	 * CTR+HMAC data still decrypts on a state that encrypts with GCM
+	 */
+	encrypted = ecc_encrypt(DEFAULT_PLAINTEXT, plen, kp, ctr);
+	g_assert(encrypted != NULL);
+	decrypted = ecc_decrypt(encrypted, kp, gcm);
+	g_assert(decrypted != NULL);
+	g_assert_cmpstr(DEFAULT_PLAINTEXT, ==, decrypted->data);
+	ecc_free_data(decrypted);
+	ecc_free_data(encrypted);
+
+	ecc_free_keypair(kp);
+	ecc_free_state(ctr);
+	ecc_free_state(gcm);
+}
+
+/*
+ * __test_encrypt_many() fans one message out to more recipients than fit
+ * in a single batch and decrypts every copy with the matching key
+ */
+void __test_encrypt_many()
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair keys[3], recipients[70];
+	unsigned int plen = strlen(DEFAULT_PLAINTEXT);
+	unsigned int msglen = ecc_encrypted_len(plen, state);
+	unsigned int i, count = 70;
+	char *out = (char *)(malloc(count * msglen));
+	char plain[64];
+
+	keys[0] = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, state);
+	keys[1] = ecc_keygen(NULL, state);
+	keys[2] = ecc_keygen(NULL, state);
+	for (i = 0; i < count; ++i)
+		recipients[i] = keys[i % 3];
+
+	g_assert(ecc_encrypt_many(DEFAULT_PLAINTEXT, plen, out, recipients, count, 
+				state));
+	for (i = 0; i < count; ++i) {
+		g_assert(ecc_decrypt_into(out + i * msglen, msglen, plain, 
+					recipients[i], state) == (int)(plen));
+		g_assert(memcmp(plain, DEFAULT_PLAINTEXT, plen) == 0);
+		if (i > 0)
+			g_assert(memcmp(out + i * msglen, out + (i - 1) * msglen, msglen) != 0);
+	}
+
+	g_assert(ecc_encrypt_many(out, plen, out, recipients, count, state) == false);
+
+	for (i = 0; i < 3; ++i)
+		ecc_free_keypair(keys[i]);
+	free(out);
+	ecc_free_state(state);
+}
+
+/*
+ * __test_decrypt_legacy() checks that data carrying the MAC of older 
+ * versions of ecc_encrypt() is refused unless the caller opts in, and is
+ * flagged when it is accepted
+ */
+void __test_decrypt_legacy()
+{
+	ECC_Options opts = ecc_new_options();
+	ECC_State strict, legacy;
+	ECC_KeyPair kp;
+	char buf[LEGACY_CIPHERTEXT_LEN];
+	struct _ECC_Data encrypted;
+	ECC_Data decrypted, fresh;
+
+	g_assert(opts != NULL);
+	g_assert(opts->legacy_mac == false);
+	opts->legacy_mac = true;
+	legacy = ecc_new_state(opts);
+	strict = ecc_new_state(NULL);
+	kp = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, strict);
+
+	memcpy(buf, LEGACY_CIPHERTEXT, LEGACY_CIPHERTEXT_LEN);
+	encrypted.data = buf;
+	encrypted.datalen = LEGACY_CIPHERTEXT_LEN;
+
+	g_assert(ecc_decrypt(&encrypted, kp, strict) == NULL);
+	g_assert(ecc_decrypt_into(buf, LEGACY_CIPHERTEXT_LEN, buf, kp, legacy) == -1);
+
+	memcpy(buf, LEGACY_CIPHERTEXT, LEGACY_CIPHERTEXT_LEN);
+	decrypted = ecc_decrypt(&encrypted, kp, legacy);
+	g_assert(decrypted != NULL);
+	g_assert(decrypted->legacy_mac);
+	g_assert_cmpstr(DEFAULT_PLAINTEXT, ==, decrypted->data);
+	ecc_free_data(decrypted);
+
+	/*
+	 * Current data is authenticated for real, on either state
+	 */
+	fresh = ecc_encrypt(DEFAULT_PLAINTEXT, strlen(DEFAULT_PLAINTEXT), kp, 
+			strict);
+	g_assert(fresh != NULL);
+	decrypted = ecc_decrypt(fresh, kp, legacy);
+	g_assert(decrypted != NULL);
+	g_assert(decrypted->legacy_mac == false);
+	g_assert_cmpstr(DEFAULT_PLAINTEXT, ==, decrypted->data);
+	ecc_free_data(decrypted);
+	ecc_free_data(fresh);
+
+	ecc_free_keypair(kp);
+	ecc_free_state(strict);
+	ecc_free_state(legacy);
+}
 
 int main(int argc, char **argv)
 {
@@ -285,22 +751,26 @@ int main(int argc, char **argv)
 	g_test_add_func("/libseccure/struct/ecc_new_data", __test_new_data);
 	g_test_add_func("/libseccure/struct/ecc_new_options", __test_new_options);
 	g_test_add_func("/libseccure/struct/ecc_new_state", __test_new_state);
+	g_test_add_func("/libseccure/struct/shared_curve", __test_shared_curve);
 
 	/*
 	 * Tests for ecc_keygen()
 	 */
 	//g_test_add_func("/libseccure/ecc_keygen/default", __test_keygen);
 	g_test_add_func("/libseccure/ecc_keygen/full", __test_full_keygen);
+	g_test_add_func("/libseccure/ecc_keygen/batch", __test_keygen_batch);
 
 
 	/*
 	 * Tests for ecc_verify()
 	 */
 	g_test_add_func("/libseccure/ecc_verify/default", __test_verify);
+	g_test_add_func("/libseccure/ecc_verify/reuse", __test_verify_reuse);
 	g_test_add_func("/libseccure/ecc_verify/null_keypair", __test_verify_nullkp);
 	g_test_add_func("/libseccure/ecc_verify/null_data", __test_verify_nulldata);
 	g_test_add_func("/libseccure/ecc_verify/null_sig", __test_verify_nullsig);
 	g_test_add_func("/libseccure/ecc_verify/crap_sig", __test_verify_crapsig);
+	g_test_add_func("/libseccure/ecc_verify_batch/default", __test_verify_batch);
 
 	/* 
 	 * Tests for ecc_sign()
@@ -308,11 +778,19 @@ int main(int argc, char **argv)
 	g_test_add_func("/libseccure/ecc_sign/default", __test_sign);
 	g_test_add_func("/libseccure/ecc_sign/null_data", __test_sign_nulldata);
 	g_test_add_func("/libseccure/ecc_sign/null_keypair", __test_sign_nullkp);
+	g_test_add_func("/libseccure/ecc_sign/bin", __test_sign_bin);
+	g_test_add_func("/libseccure/ecc_new_keypair/bin", __test_keypair_bin);
 
 	/*
 	 * Tests for ecc_encrypt()
 	 */
 	g_test_add_func("/libseccure/ecc_encrypt/default", __test_encrypt);
+	g_test_add_func("/libseccure/ecc_encrypt/stream", __test_encrypt_stream);
+	g_test_add_func("/libseccure/ecc_encrypt/into", __test_encrypt_into);
+	g_test_add_func("/libseccure/ecc_decrypt/tampered", __test_decrypt_tampered);
+	g_test_add_func("/libseccure/ecc_decrypt/legacy", __test_decrypt_legacy);
+	g_test_add_func("/libseccure/ecc_encrypt/gcm", __test_encrypt_gcm);
+	g_test_add_func("/libseccure/ecc_encrypt/many", __test_encrypt_many);
 
 
 	return g_test_run();
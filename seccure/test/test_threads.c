@@ -0,0 +1,178 @@
+/*
+ *  test_threads - Copyright 2009 Slide, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gcrypt.h>
+
+#include "libseccure.h"
+
+/*
+ * These values are built by running the seccure binary and
+ * assume the curve of DEFAULT_CURVE (currently p384)
+ */
+#define DEFAULT_DATA "This message will be signed\n"
+#define DEFAULT_SIG "#cE/UfJ@]qte8w-ajzi%S%tO<?$?@QK_hTL&pk-ES1L~C9~4lpm+P7ZXu[mXTJ:%tdhQa:z~~q)BAw{.3dvt!ub+s?sXyxk;S%&+^P-~%}+G3G?Oj-nSDc/"
+#define DEFAULT_PUBKEY "#&M=6cSQ}m6C(hUz-7j@E=>oS#TL3F[F[a[q9S;RhMh+F#gP|Q6R}lhT_e7b"
+#define DEFAULT_PRIVKEY "!!![t{l5N^uZd=Bg(P#N|PH#IN8I0,Jq/PvdVNi^PxR,(5~p-o[^hPE#40.<|"
+#define DEFAULT_PLAINTEXT "This is a very very secret message!\n"
+
+#define THREADS 8
+#define LOOPS 25
+
+struct shared {
+	ECC_State state;
+	ECC_KeyPair keypair;
+};
+
+/*
+ * Run every operation against the given state and keypair, checking the
+ * results against the known values
+ */
+static void __hammer(ECC_State state, ECC_KeyPair keypair)
+{
+	ECC_Data signature, encrypted, decrypted;
+	unsigned int i = 0;
+
+	for (; i < LOOPS; ++i) {
+		signature = ecc_sign(DEFAULT_DATA, keypair, state);
+		g_assert(signature != NULL);
+		g_assert_cmpstr(DEFAULT_SIG, ==, signature->data);
+		ecc_free_data(signature);
+
+		g_assert(ecc_verify(DEFAULT_DATA, DEFAULT_SIG, keypair, state));
+		g_assert(ecc_verify("Not the signed data", DEFAULT_SIG, keypair,
+					state) == false);
+
+		encrypted = ecc_encrypt(DEFAULT_PLAINTEXT, strlen(DEFAULT_PLAINTEXT),
+				keypair, state);
+		g_assert(encrypted != NULL);
+		decrypted = ecc_decrypt(encrypted, keypair, state);
+		g_assert(decrypted != NULL);
+		g_assert_cmpstr(DEFAULT_PLAINTEXT, ==, decrypted->data);
+		ecc_free_data(encrypted);
+		ecc_free_data(decrypted);
+	}
+}
+
+static void *__shared_worker(void *arg)
+{
+	struct shared *s = (struct shared *)(arg);
+	__hammer(s->state, s->keypair);
+	return NULL;
+}
+
+static void *__private_worker(void *arg)
+{
+	ECC_State state = ecc_new_state(NULL);
+	ECC_KeyPair keypair;
+
+	g_assert(state != NULL);
+	keypair = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, state);
+	g_assert(keypair != NULL);
+
+	__hammer(state, keypair);
+
+	ecc_free_keypair(keypair);
+	ecc_free_state(state);
+	return NULL;
+}
+
+static void __run_threads(void *(*worker)(void *), void *arg)
+{
+	pthread_t threads[THREADS];
+	unsigned int i;
+
+	for (i = 0; i < THREADS; ++i)
+		g_assert(pthread_create(&threads[i], NULL, worker, arg) == 0);
+	for (i = 0; i < THREADS; ++i)
+		g_assert(pthread_join(threads[i], NULL) == 0);
+}
+
+/*
+ * __test_shared_state() shares a single ::ECC_State and ::ECC_KeyPair
+ * between all threads, the way a worker pool would
+ */
+void __test_shared_state()
+{
+	struct shared s;
+
+	s.state = ecc_new_state(NULL);
+	s.keypair = ecc_new_keypair(DEFAULT_PUBKEY, DEFAULT_PRIVKEY, s.state);
+	g_assert(s.state != NULL);
+	g_assert(s.keypair != NULL);
+
+	__run_threads(__shared_worker, &s);
+
+	ecc_free_keypair(s.keypair);
+	ecc_free_state(s.state);
+}
+
+/*
+ * __test_private_state() has each thread set up and tear down its own
+ * ::ECC_State concurrently with the others
+ */
+void __test_private_state()
+{
+	__run_threads(__private_worker, NULL);
+}
+
+/*
+ * __test_keygen_many() spreads ecc_keygen_many() over the worker pool and
+ * checks that every slice produced working, distinct keys
+ */
+void __test_keygen_many()
+{
+	ECC_State state = ecc_new_state(NULL);
+	unsigned int n = 3 * 64 + 5, i, j;
+	ECC_KeyPair *keys = ecc_keygen_many(n, state, THREADS);
+	ECC_Data signature;
+
+	g_assert(keys != NULL);
+	for (i = 0; i < n; ++i) {
+		g_assert(keys[i] != NULL);
+		g_assert(keys[i]->pub != NULL);
+		for (j = 0; j < i; ++j)
+			g_assert(strcmp(keys[i]->pub, keys[j]->pub) != 0);
+
+		signature = ecc_sign(DEFAULT_DATA, keys[i], state);
+		g_assert(signature != NULL);
+		g_assert(ecc_verify(DEFAULT_DATA, signature->data, keys[i], state));
+		ecc_free_data(signature);
+	}
+
+	ecc_free_keypairs(keys, n);
+	ecc_free_state(state);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/threads/shared_state", __test_shared_state);
+	g_test_add_func("/threads/private_state", __test_private_state);
+	g_test_add_func("/threads/keygen_many", __test_keygen_many);
+
+	return g_test_run();
+}
@@ -14,6 +14,7 @@ base_modules = [
     Extension('_pyecc', [
             'seccure/libseccure.c',
             'seccure/numtheory.c',
+            'seccure/field.c',
             'seccure/ecc.c',
             'seccure/serialize.c',
             'seccure/protocol.c',
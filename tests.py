@@ -6,6 +6,7 @@
 import copy
 import gc
 import sys
+import threading
 import types
 import unittest
 
@@ -20,6 +21,8 @@ DEFAULT_SIG = '#cE/UfJ@]qte8w-ajzi%S%tO<?$?@QK_hTL&pk-ES1L~C9~4lpm+P7ZXu[mXTJ:%t
 DEFAULT_PUBKEY = '#&M=6cSQ}m6C(hUz-7j@E=>oS#TL3F[F[a[q9S;RhMh+F#gP|Q6R}lhT_e7b'
 DEFAULT_PRIVKEY = '!!![t{l5N^uZd=Bg(P#N|PH#IN8I0,Jq/PvdVNi^PxR,(5~p-o[^hPE#40.<|'
 DEFAULT_PLAINTEXT = 'This is a very very secret message!\n'
+# DEFAULT_PLAINTEXT as encrypted by versions whose MAC covered no data
+LEGACY_CIPHERTEXT = "\x01\xa9\xc0\x1a\x03\\h\xd8\xea,\x8f\xd6\x91W\x8d\xe74x:\x1d\xa8 \xee\x0eD\xfe\xb6\xb0P\x04\xbf\xd5=\xf1?\x00\x9cDw\xae\x0b\xc3\x05BuX\xf1\x9a\x05f\x81\xd1\x15\x8c\x80Q\xa6\xf9\xd7\xf0\x8e\x99\xf2\x11<t\xff\x92\x14\x1c%0W\x8e\x8f\n\n\x9ed\xf8\xff\xc7p\r\x03\xbbw|\xb1h\xc9\xbd+\x02\x87"
 LOOPS = 100
 
 class ECC_KeyGen_Tests(unittest.TestCase):
@@ -37,6 +40,15 @@ class ECC_KeyGen_Tests(unittest.TestCase):
         assert decrypted == DEFAULT_PLAINTEXT, ('Decrypted wrong',
             decrypted, DEFAULT_PLAINTEXT)
 
+    def test_GenerateMany(self):
+        keys = pyecc.ECC.generate_many(70, threads=2)
+        assert len(keys) == 70, ('Wrong number of keys', len(keys))
+        assert len(set(k._public for k in keys)) == 70, 'Duplicate keys'
+
+        for ecc in (keys[0], keys[-1]):
+            encrypted = ecc.encrypt(DEFAULT_PLAINTEXT)
+            assert ecc.decrypt(encrypted) == DEFAULT_PLAINTEXT
+
 class ECC_Verify_Tests(unittest.TestCase):
     def setUp(self):
         super(ECC_Verify_Tests, self).setUp()
@@ -66,6 +78,24 @@ class ECC_Sign_Tests(unittest.TestCase):
 
         assert signature == None, ('Should have a None sig')
 
+class ECC_Binary_Tests(unittest.TestCase):
+    def setUp(self):
+        super(ECC_Binary_Tests, self).setUp()
+        self.ecc = pyecc.ECC(public=DEFAULT_PUBKEY, private=DEFAULT_PRIVKEY)
+
+    def test_SignVerify(self):
+        data = DEFAULT_DATA + '\0binary'
+        signature = self.ecc.sign_bin(data)
+        assert signature
+        assert self.ecc.verify_bin(data, signature)
+        assert not self.ecc.verify_bin(DEFAULT_DATA, signature)
+
+    def test_BinaryKeys(self):
+        public, private = self.ecc.export_bin()
+        ecc = pyecc.ECC(public=public, private=private, binary=True)
+        assert ecc.sign(DEFAULT_DATA) == DEFAULT_SIG
+        assert self.ecc.decrypt(ecc.encrypt(DEFAULT_PLAINTEXT)) == DEFAULT_PLAINTEXT
+
 class ECC_Encrypt_Tests(unittest.TestCase):
     def setUp(self):
         super(ECC_Encrypt_Tests, self).setUp()
@@ -86,10 +116,15 @@ class ECC_Decrypt_Tests(unittest.TestCase):
         self.ecc = pyecc.ECC(public=DEFAULT_PUBKEY, private=DEFAULT_PRIVKEY)
 
     def test_BasicDecrypt(self):
-        encrypted = "\x01\xa9\xc0\x1a\x03\\h\xd8\xea,\x8f\xd6\x91W\x8d\xe74x:\x1d\xa8 \xee\x0eD\xfe\xb6\xb0P\x04\xbf\xd5=\xf1?\x00\x9cDw\xae\x0b\xc3\x05BuX\xf1\x9a\x05f\x81\xd1\x15\x8c\x80Q\xa6\xf9\xd7\xf0\x8e\x99\xf2\x11<t\xff\x92\x14\x1c%0W\x8e\x8f\n\n\x9ed\xf8\xff\xc7p\r\x03\xbbw|\xb1h\xc9\xbd+\x02\x87"
-        decrypted = self.ecc.decrypt(encrypted)
+        self.ecc = pyecc.ECC(public=DEFAULT_PUBKEY, private=DEFAULT_PRIVKEY,
+                legacy_mac=True)
+        decrypted = self.ecc.decrypt(LEGACY_CIPHERTEXT)
         assert decrypted  == DEFAULT_PLAINTEXT
 
+    def test_LegacyRejected(self):
+        decrypted = self.ecc.decrypt(LEGACY_CIPHERTEXT)
+        assert decrypted is None, ('Accepted a legacy MAC', decrypted)
+
 class ECC_Fail(unittest.TestCase):
     def setUp(self):
         super(ECC_Fail, self).setUp()
@@ -118,6 +153,32 @@ class ECC_GC_Checks(unittest.TestCase):
                 assert objects == l, (l, objects, 'Count is off')
             objects = l
 
+class ECC_Thread_Tests(unittest.TestCase):
+    THREADS = 4
+
+    def setUp(self):
+        super(ECC_Thread_Tests, self).setUp()
+        self.ecc = pyecc.ECC(public=DEFAULT_PUBKEY, private=DEFAULT_PRIVKEY)
+
+    def test_SharedObject(self):
+        failures = []
+        def worker():
+            for i in xrange(LOOPS / 10):
+                if not self.ecc.verify(DEFAULT_DATA, DEFAULT_SIG):
+                    failures.append('verify')
+                if self.ecc.sign(DEFAULT_DATA) != DEFAULT_SIG:
+                    failures.append('sign')
+                encrypted = self.ecc.encrypt(DEFAULT_PLAINTEXT)
+                if self.ecc.decrypt(encrypted) != DEFAULT_PLAINTEXT:
+                    failures.append('decrypt')
+
+        threads = [threading.Thread(target=worker) for i in xrange(self.THREADS)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        assert not failures, failures
+
 if __name__ == '__main__':
     suites = []
     items = copy.copy(locals())